@@ -29,6 +29,80 @@ int args_parse(CFG* config, int argc, char** argv){
 				return -1;
 			}
 		}
+		else if(!strcmp(argv[i], "-hysteresis")){
+			if(++i<argc){
+				config->size_hysteresis=strtoul(argv[i], NULL, 10);
+			}
+			else{
+				fprintf(stderr, "No parameter for size hysteresis\n");
+				return -1;
+			}
+		}
+		else if(!strcmp(argv[i], "-history-lines")){
+			if(++i<argc){
+				config->history_lines=strtoul(argv[i], NULL, 10);
+			}
+			else{
+				fprintf(stderr, "No parameter for history lines\n");
+				return -1;
+			}
+		}
+		else if(!strcmp(argv[i], "-history-bytes")){
+			if(++i<argc){
+				config->history_bytes=strtoul(argv[i], NULL, 10);
+			}
+			else{
+				fprintf(stderr, "No parameter for history bytes\n");
+				return -1;
+			}
+		}
+		else if(!strcmp(argv[i], "-frame-delimiter")){
+			if(++i<argc){
+				if(!strcmp(argv[i], "nul")){
+					config->frame_delimiter=0;
+				}
+				else if(!strcmp(argv[i], "etb")){
+					config->frame_delimiter=0x17;
+				}
+				else{
+					config->frame_delimiter=strtoul(argv[i], NULL, 0)&0xFF;
+				}
+			}
+			else{
+				fprintf(stderr, "No parameter for frame delimiter\n");
+				return -1;
+			}
+		}
+		else if(!strcmp(argv[i], "-maxfps")){
+			if(++i<argc){
+				config->max_fps=strtoul(argv[i], NULL, 10);
+			}
+			else{
+				fprintf(stderr, "No parameter for frame rate limit\n");
+				return -1;
+			}
+		}
+		else if(!strcmp(argv[i], "-line-cache")){
+			if(++i<argc){
+				config->line_cache=strtoul(argv[i], NULL, 10);
+			}
+			else{
+				fprintf(stderr, "No parameter for line cache size\n");
+				return -1;
+			}
+		}
+		else if(!strcmp(argv[i], "-measure-threads")){
+			if(++i<argc){
+				config->measure_threads=strtoul(argv[i], NULL, 10);
+				if(config->measure_threads<1){
+					config->measure_threads=1;
+				}
+			}
+			else{
+				fprintf(stderr, "No parameter for measurement threads\n");
+				return -1;
+			}
+		}
 		else if(!strcmp(argv[i], "-align")){
 			if(++i<argc){
 				switch(argv[i][0]){
@@ -80,6 +154,27 @@ int args_parse(CFG* config, int argc, char** argv){
 				return -1;
 			}
 		}
+		else if(!strcmp(argv[i], "-metrics")){
+			if(++i<argc){
+				if(!strcmp(argv[i], "xft")){
+					config->metrics=METRICS_XFT;
+				}
+				else if(!strcmp(argv[i], "outline")){
+					config->metrics=METRICS_OUTLINE;
+				}
+				else if(!strcmp(argv[i], "compare")){
+					config->metrics=METRICS_COMPARE;
+				}
+				else{
+					fprintf(stderr, "Invalid metrics backend\n");
+					return -1;
+				}
+			}
+			else{
+				fprintf(stderr, "No parameter for metrics backend\n");
+				return -1;
+			}
+		}
 		else if(!strcmp(argv[i], "-size")){
 			if(++i<argc){
 				config->force_size=(double)strtoul(argv[i], NULL, 10);
@@ -98,6 +193,12 @@ int args_parse(CFG* config, int argc, char** argv){
 		else if(!strcmp(argv[i], "-disable-doublebuffer")){
 			config->double_buffer=false;
 		}
+		else if(!strcmp(argv[i], "-layout-thread")){
+			config->layout_thread=true;
+		}
+		else if(!strcmp(argv[i], "-shm")){
+			config->shm_render=true;
+		}
 		else if(!strcmp(argv[i], "-fc")){
 			if(++i<argc&&!(config->text_color)){
 				config->text_color=calloc(strlen(argv[i])+1, sizeof(char));
@@ -129,6 +230,9 @@ int args_parse(CFG* config, int argc, char** argv){
 		else if(!strcmp(argv[i], "-stdin")){
 			config->handle_stdin=true;
 		}
+		else if(!strcmp(argv[i], "-drain")){
+			config->drain_input=true;
+		}
 		else if(!strcmp(argv[i], "-debugboxes")){
 			config->debug_boxes=true;
 		}
@@ -214,12 +318,22 @@ bool args_sane(CFG* config){
 		fprintf(stderr, "Verbosity level: %d\n", config->verbosity);
 		fprintf(stderr, "Text padding: %d\n", config->padding);
 		fprintf(stderr, "Line spacing: %d\n", config->line_spacing);
+		fprintf(stderr, "Measurement threads: %d\n", config->measure_threads);
+		fprintf(stderr, "History limits: %d lines, %lu bytes\n", config->history_lines, config->history_bytes);
 		fprintf(stderr, "Maximum size: %d\n", config->max_size);
+		fprintf(stderr, "Size hysteresis: %d\n", config->size_hysteresis);
 		fprintf(stderr, "Text alignment: %d\n", config->alignment);
+		fprintf(stderr, "Metrics backend: %d\n", config->metrics);
 		fprintf(stderr, "Resize lines independently: %s\n", config->independent_resize?"true":"false");
 		fprintf(stderr, "Handle stdin: %s\n", config->handle_stdin?"true":"false");
+		fprintf(stderr, "Drain to latest frame: %s\n", config->drain_input?"true":"false");
+		fprintf(stderr, "Frame delimiter: %d\n", config->frame_delimiter);
+		fprintf(stderr, "Frame rate limit: %d\n", config->max_fps);
+		fprintf(stderr, "Line cache: %d KiB\n", config->line_cache);
 		fprintf(stderr, "Draw debug boxes: %s\n", config->debug_boxes?"true":"false");
 		fprintf(stderr, "Disable text draw: %s\n", config->disable_text?"true":"false");
+		fprintf(stderr, "Layout in worker thread: %s\n", config->layout_thread?"true":"false");
+		fprintf(stderr, "Client side rendering: %s\n", config->shm_render?"true":"false");
 		fprintf(stderr, "Forced text size: %d\n", (int)config->force_size);
 		fprintf(stderr, "Text colorspec: %s\n", config->text_color);
 		fprintf(stderr, "Window colorspec: %s\n", config->bg_color);
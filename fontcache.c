@@ -0,0 +1,87 @@
+FONTCACHE_ENTRY* fontcache_entry(XRESOURCES* xres, CFG* config, double size){
+	unsigned i, slot=0;
+	FONTCACHE* cache=&(xres->fonts);
+	FONTCACHE_ENTRY* entry;
+	FcPattern* pattern;
+
+	cache->use_counter++;
+
+	for(i=0;i<FONTCACHE_SIZE;i++){
+		entry=cache->entries+i;
+		if(entry->font&&entry->size==size&&!strcmp(entry->family, config->font_name)){
+			entry->last_use=cache->use_counter;
+			return entry;
+		}
+
+		//prefer empty slots, else evict least recently used
+		if(cache->entries[slot].font&&(!entry->font||entry->last_use<cache->entries[slot].last_use)){
+			slot=i;
+		}
+	}
+
+	entry=cache->entries+slot;
+	if(entry->font&&cache->pinned_from&&entry->last_use>=cache->pinned_from){
+		//the least recently used font is still referenced
+		errlog(config, LOG_DEBUG, "All font cache slots are pinned\n");
+		return NULL;
+	}
+	if(entry->font){
+		errlog(config, LOG_DEBUG, "Evicting font cache slot %d (%s, %d)\n", slot, entry->family, (int)entry->size);
+		glyphs_free(&(entry->glyphs));
+		XftFontClose(xres->display, entry->font);
+		entry->font=NULL;
+	}
+
+	if(!entry->family||strcmp(entry->family, config->font_name)){
+		entry->family=realloc(entry->family, (strlen(config->font_name)+1)*sizeof(char));
+		if(!entry->family){
+			fprintf(stderr, "Failed to allocate memory\n");
+			return NULL;
+		}
+		strcpy(entry->family, config->font_name);
+	}
+
+	//open from the pattern resolved in x11_init, only the size changes
+	pattern=FcPatternDuplicate(xres->font_pattern);
+	if(!pattern){
+		fprintf(stderr, "Failed to copy font pattern\n");
+		return NULL;
+	}
+	FcPatternDel(pattern, FC_PIXEL_SIZE);
+	FcPatternDel(pattern, FC_SIZE);
+	FcPatternAddDouble(pattern, FC_PIXEL_SIZE, size);
+
+	//the font takes ownership of the pattern
+	entry->font=XftFontOpenPattern(xres->display, pattern);
+	if(!entry->font){
+		FcPatternDestroy(pattern);
+		fprintf(stderr, "Failed to load font (%s, %d)\n", config->font_name, (int)size);
+		return NULL;
+	}
+	errlog(config, LOG_DEBUG, "Opened font (%s, %d) into cache slot %d\n", config->font_name, (int)size, slot);
+
+	entry->size=size;
+	entry->glyphs.display=xres->display;
+	entry->glyphs.font=entry->font;
+	entry->last_use=cache->use_counter;
+	return entry;
+}
+
+XftFont* fontcache_get(XRESOURCES* xres, CFG* config, double size){
+	FONTCACHE_ENTRY* entry=fontcache_entry(xres, config, size);
+	return entry?entry->font:NULL;
+}
+
+void fontcache_free(XRESOURCES* xres){
+	unsigned i;
+
+	for(i=0;i<FONTCACHE_SIZE;i++){
+		glyphs_free(&(xres->fonts.entries[i].glyphs));
+		if(xres->fonts.entries[i].font){
+			XftFontClose(xres->display, xres->fonts.entries[i].font);
+			xres->fonts.entries[i].font=NULL;
+		}
+		free(xres->fonts.entries[i].family);
+		xres->fonts.entries[i].family=NULL;
+	}
+}
@@ -0,0 +1,116 @@
+unsigned linecache_hash(char* text){
+	unsigned hash=2166136261u;
+
+	for(;*text;text++){
+		hash=(hash^(unsigned char)*text)*16777619u;
+	}
+	return hash;
+}
+
+void linecache_evict(XRESOURCES* xres, unsigned index){
+	LINECACHE* cache=&(xres->lines);
+	LINECACHE_ENTRY* entry=cache->entries+index;
+
+	//requests already queued against the pixmap are still served
+	XFreePixmap(xres->display, entry->pixmap);
+	free(entry->text);
+	cache->bytes-=entry->bytes;
+
+	//keep the entries dense
+	cache->num_entries--;
+	*entry=cache->entries[cache->num_entries];
+}
+
+LINECACHE_ENTRY* linecache_get(XRESOURCES* xres, CFG* config, TEXTBLOCK* block){
+	unsigned i, oldest, hash=linecache_hash(block->text);
+	unsigned long bytes=(unsigned long)block->extents.width*block->extents.height*4, budget=config->line_cache*1024UL;
+	LINECACHE* cache=&(xres->lines);
+	LINECACHE_ENTRY* entry;
+	XftDraw* draw;
+	XftFont* font;
+
+	cache->use_counter++;
+
+	//colors are fixed for the process, so text and size identify a line
+	for(i=0;i<cache->num_entries;i++){
+		entry=cache->entries+i;
+		if(entry->hash==hash&&entry->size==block->size&&!strcmp(entry->text, block->text)){
+			entry->last_use=cache->use_counter;
+			return entry;
+		}
+	}
+
+	if(!bytes||bytes>budget){
+		return NULL;
+	}
+
+	//evict least recently used lines until the new one fits
+	while(cache->num_entries&&cache->bytes+bytes>budget){
+		oldest=0;
+		for(i=1;i<cache->num_entries;i++){
+			if(cache->entries[i].last_use<cache->entries[oldest].last_use){
+				oldest=i;
+			}
+		}
+		errlog(config, LOG_DEBUG, "Evicting line cache entry (%s, %d)\n", cache->entries[oldest].text, (int)cache->entries[oldest].size);
+		linecache_evict(xres, oldest);
+	}
+
+	if(cache->num_entries==cache->entries_size){
+		entry=realloc(cache->entries, (cache->entries_size?(2*cache->entries_size):16)*sizeof(LINECACHE_ENTRY));
+		if(!entry){
+			fprintf(stderr, "Failed to allocate memory\n");
+			return NULL;
+		}
+		cache->entries=entry;
+		cache->entries_size=cache->entries_size?(2*cache->entries_size):16;
+	}
+
+	//may fail while fonts are pinned, the line is then drawn directly
+	font=fontcache_get(xres, config, block->size);
+	if(!font){
+		return NULL;
+	}
+
+	entry=cache->entries+cache->num_entries;
+	entry->text=calloc(strlen(block->text)+1, sizeof(char));
+	if(!entry->text){
+		fprintf(stderr, "Failed to allocate memory\n");
+		return NULL;
+	}
+	strcpy(entry->text, block->text);
+
+	//render the line once, later frames copy it
+	entry->pixmap=XCreatePixmap(xres->display, xres->main, block->extents.width, block->extents.height, DefaultDepth(xres->display, xres->screen));
+	draw=XftDrawCreate(xres->display, entry->pixmap, DefaultVisual(xres->display, xres->screen), DefaultColormap(xres->display, xres->screen));
+	if(!draw){
+		fprintf(stderr, "Failed to allocate line drawable\n");
+		XFreePixmap(xres->display, entry->pixmap);
+		free(entry->text);
+		return NULL;
+	}
+	XftDrawRect(draw, &(xres->bg_color), 0, 0, block->extents.width, block->extents.height);
+	XftDrawStringUtf8(draw, &(xres->text_color), font, block->extents.x, block->extents.y, (FcChar8*)block->text, strlen(block->text));
+	XftDrawDestroy(draw);
+
+	entry->hash=hash;
+	entry->size=block->size;
+	entry->width=block->extents.width;
+	entry->height=block->extents.height;
+	entry->bytes=bytes;
+	entry->last_use=cache->use_counter;
+	cache->bytes+=bytes;
+	cache->num_entries++;
+
+	errlog(config, LOG_DEBUG, "Cached line (%s, %d), %lu bytes in cache\n", entry->text, (int)entry->size, cache->bytes);
+	return entry;
+}
+
+void linecache_free(XRESOURCES* xres){
+	while(xres->lines.num_entries){
+		linecache_evict(xres, 0);
+	}
+	free(xres->lines.entries);
+	xres->lines.entries=NULL;
+	xres->lines.entries_size=0;
+}
@@ -1,36 +1,210 @@
-int xecho(CFG* config, XRESOURCES* xres, char* initial_text){
-	fd_set readfds;
-	struct timeval tv;
-	int maxfd, error;
+long xecho_elapsed(struct timespec* since){
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec-since->tv_sec)*1000000000L+(now.tv_nsec-since->tv_nsec);
+}
+
+bool xecho_layout(CFG* config, XRESOURCES* xres, LAYOUT_WORKER* worker, TEXTBLOCK** blocks, unsigned width, unsigned height){
+	struct timespec start;
+	bool rv;
+
+	if(config->layout_thread){
+		//the result is collected via the worker notification
+		return worker_submit(worker, blocks, width, height);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rv=x11_recalculate_blocks(config, xres, blocks, width, height);
+	xres->stats.layout_ns+=xecho_elapsed(&start);
+	return rv;
+}
+
+bool xecho_watch(int epoll_fd, int fd){
+	struct epoll_event event;
+
+	event.events=EPOLLIN;
+	event.data.fd=fd;
+	return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event)==0;
+}
+
+bool xecho_resize(CFG* config, XRESOURCES* xres, LAYOUT_WORKER* worker, TEXTBLOCK** blocks, unsigned width, unsigned height){
+	errlog(config, LOG_DEBUG, "Recalculating blocks for %dx%d\n", width, height);
+
+	//recalculate size
+	if(!xecho_layout(config, xres, worker, blocks, width, height)){
+		fprintf(stderr, "Block calculation failed\n");
+		return false;
+	}
+
+	if(config->double_buffer){
+		//update drawable
+		if(xres->back_pixmap){
+			x11_back_pixmap(xres, width, height);
+		}
+		XftDrawChange(xres->drawable, xres->back_buffer);
+	}
+	if(config->shm_render&&!shm_resize(xres, config, width, height)){
+		fprintf(stderr, "Falling back to Xft rendering\n");
+		config->shm_render=false;
+	}
+	xres->damage.full=true;
+	return true;
+}
+
+bool xecho_render(CFG* config, XRESOURCES* xres, TEXTBLOCK** blocks){
+	XdbeSwapInfo swap_info;
+	bool full=xres->damage.full;
 	unsigned i;
+
+	if(!xres->stats.frames_drawn){
+		clock_gettime(CLOCK_MONOTONIC, &(xres->stats.first_frame));
+	}
+	if(!x11_draw_blocks(config, xres, blocks)){
+		fprintf(stderr, "Failed to draw blocks\n");
+		return false;
+	}
+	if(config->double_buffer&&xres->back_pixmap){
+		//the pixmap is retained like an XdbeCopied buffer, only the damage changed
+		if(full){
+			errlog(config, LOG_DEBUG, "Copying back pixmap\n");
+			XCopyArea(xres->display, xres->back_buffer, xres->main, xres->copy_gc, 0, 0, xres->back_width, xres->back_height, 0, 0);
+		}
+		for(i=0;!full&&i<xres->damage.num_rects;i++){
+			XCopyArea(xres->display, xres->back_buffer, xres->main, xres->copy_gc,
+					xres->damage.rects[i].x, xres->damage.rects[i].y,
+					xres->damage.rects[i].width, xres->damage.rects[i].height,
+					xres->damage.rects[i].x, xres->damage.rects[i].y);
+		}
+	}
+	else if(config->double_buffer){
+		errlog(config, LOG_DEBUG, "Swapping buffers\n");
+		swap_info.swap_window=xres->main;
+		//keep the back buffer, only damaged areas are drawn again
+		swap_info.swap_action=XdbeCopied;
+		XdbeSwapBuffers(xres->display, &swap_info, 1);
+	}
+	xres->stats.frames_drawn++;
+	return true;
+}
+
+int xecho(CFG* config, XRESOURCES* xres, char* initial_text){
+	struct epoll_event events[EVENT_BATCH];
+	struct signalfd_siginfo signal_info;
+	struct itimerspec timer;
+	sigset_t signals;
+	uint64_t expirations;
+	int epoll_fd, timer_fd, resize_fd, signal_fd;
+	int error, n;
 	int abort=0;
 	XEvent event;
-	XdbeSwapInfo swap_info;
 
 	unsigned window_width=0, window_height=0;
-	unsigned display_buffer_length=0, display_buffer_offset;
 
 	TEXTBLOCK** blocks=NULL;
-	char* display_buffer=NULL;
+	TEXTBLOCK** layout=NULL;
+	char* stdin_buffer=NULL;
+	unsigned stdin_buffer_length=0, reads;
+	bool committed, update_pending=false, timer_armed=false, redraw=false;
+	bool stdin_ready, worker_ready, resize_ready, stdin_always=false;
+	bool resize_pending=false;
+	unsigned resize_width=0, resize_height=0;
+	struct timespec last_update={0, 0};
+	long frame_interval=config->max_fps?(1000000000L/config->max_fps):0, wait, elapsed;
+	STRING_STREAM stream;
+	LAYOUT_WORKER worker;
+	MEASURE_POOL pool;
+
+	//termination signals are read from a signalfd, block them before any thread starts
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	//start layout worker
+	memset(&worker, 0, sizeof(LAYOUT_WORKER));
+	if(config->layout_thread&&!worker_start(&worker, config, xres)){
+		fprintf(stderr, "Falling back to layout in the main thread\n");
+		config->layout_thread=false;
+	}
+
+	//start measurement threads, they only work with outline metrics
+	memset(&pool, 0, sizeof(MEASURE_POOL));
+	if(config->measure_threads>1){
+		if(!config->layout_thread&&config->metrics!=METRICS_OUTLINE){
+			fprintf(stderr, "Parallel measurement requires outline metrics, measuring on one thread\n");
+		}
+		else if(!pool_start(&pool, config, xres->font_pattern)){
+			fprintf(stderr, "Measuring on one thread\n");
+		}
+		else if(config->layout_thread){
+			worker.res.pool=&pool;
+		}
+		else{
+			xres->pool=&pool;
+		}
+	}
 	
-	//prepare initial block buffer
-	if(initial_text){
-		if(!string_blockify(&blocks, initial_text)){
-			fprintf(stderr, "Failed to blockify initial input text\n");
-			return -1;
+	//set up the event loop
+	epoll_fd=epoll_create1(EPOLL_CLOEXEC);
+	timer_fd=timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	resize_fd=timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	signal_fd=signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	if(epoll_fd<0||timer_fd<0||resize_fd<0||signal_fd<0){
+		perror("Failed to create event loop descriptors");
+		abort=-1;
+	}
+
+	//setup failures still pass through the common teardown below
+	if(!abort&&(!xfd_watch(&(xres->xfds), epoll_fd)
+			|| !xecho_watch(epoll_fd, timer_fd)
+			|| !xecho_watch(epoll_fd, resize_fd)
+			|| !xecho_watch(epoll_fd, signal_fd)
+			|| (config->layout_thread&&!xecho_watch(epoll_fd, worker.notify[0])))){
+		perror("Failed to watch event loop descriptors");
+		abort=-1;
+	}
+
+	if(!abort&&config->handle_stdin&&!xecho_watch(epoll_fd, fileno(stdin))){
+		if(errno!=EPERM){
+			perror("Failed to watch stdin");
+			abort=-1;
 		}
+		//regular files can not be polled, but never block either
+		stdin_always=true;
 	}
 
-	//copy initial text to stdin buffer
-	if(config->handle_stdin){
-		display_buffer_length=STDIN_DATA_CHUNK+(initial_text?strlen(initial_text):0)+1;
-		display_buffer=calloc(display_buffer_length, sizeof(char));
-		if(!display_buffer){
+	//read buffer, larger when draining so one read reaches the latest frame
+	if(!abort&&config->handle_stdin){
+		stdin_buffer_length=config->drain_input?STDIN_DRAIN_CHUNK:STDIN_DATA_CHUNK;
+		stdin_buffer=calloc(stdin_buffer_length, sizeof(char));
+		if(!stdin_buffer){
 			fprintf(stderr, "Failed to allocate memory\n");
-			return -1;
+			abort=-1;
 		}
-		if(initial_text){
-			strncpy(display_buffer, initial_text, strlen(initial_text));
+	}
+
+	//prepare initial block buffer, stdin data continues the initial text
+	memset(&stream, 0, sizeof(STRING_STREAM));
+	stream.max_lines=config->history_lines;
+	stream.max_bytes=config->history_bytes;
+	//every line costs at least its break, so the byte budget bounds the line count too
+	if(stream.max_bytes&&stream.max_bytes<UINT_MAX&&(!stream.max_lines||stream.max_bytes<stream.max_lines)){
+		stream.max_lines=stream.max_bytes;
+	}
+	stream.delimiter=config->frame_delimiter;
+	if(!abort&&initial_text){
+		if(config->handle_stdin){
+			if(!string_stream_feed(&stream, initial_text, strlen(initial_text))){
+				fprintf(stderr, "Failed to blockify initial input text\n");
+				abort=-1;
+			}
+			blocks=string_stream_view(&stream);
+		}
+		else if(!string_blockify(&blocks, initial_text)){
+			fprintf(stderr, "Failed to blockify initial input text\n");
+			abort=-1;
 		}
 	}
 
@@ -42,21 +216,25 @@ int xecho(CFG* config, XRESOURCES* xres, char* initial_text){
 			switch(event.type){
 				case ConfigureNotify:
 					errlog(config, LOG_INFO, "Window configured to %dx%d\n", event.xconfigure.width, event.xconfigure.height);
-					if(window_width!=event.xconfigure.width||window_height!=event.xconfigure.height){
+					if(!window_width&&!window_height){
+						//the initial size is laid out right away
 						window_width=event.xconfigure.width;
 						window_height=event.xconfigure.height;
-
-						errlog(config, LOG_DEBUG, "Recalculating blocks\n");
-
-						//recalculate size
-						if(!x11_recalculate_blocks(config, xres, blocks, window_width, window_height)){
-							fprintf(stderr, "Block calculation failed\n");
+						if(!xecho_resize(config, xres, &worker, blocks, window_width, window_height)){
 							abort=-1;
 						}
-						
-						if(config->double_buffer){
-							//update drawable
-							XftDrawChange(xres->drawable, xres->back_buffer);
+					}
+					else if(window_width!=event.xconfigure.width||window_height!=event.xconfigure.height||resize_pending){
+						//wait for the geometry to settle, every change restarts the timer
+						resize_width=event.xconfigure.width;
+						resize_height=event.xconfigure.height;
+						resize_pending=true;
+
+						memset(&timer, 0, sizeof(timer));
+						timer.it_value.tv_nsec=CONFIGURE_SETTLE_MS*1000000L;
+						if(timerfd_settime(resize_fd, 0, &timer, NULL)){
+							perror("timerfd_settime");
+							abort=-1;
 						}
 					}
 					else{
@@ -65,23 +243,23 @@ int xecho(CFG* config, XRESOURCES* xres, char* initial_text){
 					break;
 				
 				case Expose:
-					//draw here
-					errlog(config, LOG_INFO, "Expose message, initiating redraw\n");
-					if(!config->double_buffer){
-						errlog(config, LOG_DEBUG, "Clearing window\n");
-						XClearWindow(xres->display, xres->main);
-					}
-					if(!x11_draw_blocks(config, xres, blocks)){
-						fprintf(stderr, "Failed to draw blocks\n");
-						abort=-1;
-					}
-					if(config->double_buffer){
-						errlog(config, LOG_DEBUG, "Swapping buffers\n");
-						swap_info.swap_window=xres->main;
-						swap_info.swap_action=XdbeBackground;
-						XdbeSwapBuffers(xres->display, &swap_info, 1);
+					if(config->double_buffer&&xres->damage.frame&&!xres->damage.full&&!resize_pending){
+						//the back buffer still holds the last frame, copy back what was lost
+						//while a resize settles, the window may be larger than that frame
+						errlog(config, LOG_DEBUG, "Expose message, copying %dx%d at %d|%d\n", event.xexpose.width, event.xexpose.height, event.xexpose.x, event.xexpose.y);
+						XCopyArea(xres->display, xres->back_buffer, xres->main, xres->copy_gc,
+								event.xexpose.x, event.xexpose.y,
+								event.xexpose.width, event.xexpose.height,
+								event.xexpose.x, event.xexpose.y);
+						break;
 					}
 
+					//redraw once the last expose of a series is in
+					errlog(config, LOG_INFO, "Expose message, initiating redraw\n");
+					if(!event.xexpose.count){
+						xres->damage.full=true;
+						redraw=true;
+					}
 					break;
 
 				case KeyPress:
@@ -91,12 +269,15 @@ int xecho(CFG* config, XRESOURCES* xres, char* initial_text){
 							break;
 						case 27:
 							errlog(config, LOG_INFO, "Redrawing on request\n");
-							if(!x11_recalculate_blocks(config, xres, blocks, window_width, window_height)){
+							//an unchanged layout has no damage, but the window may be corrupted
+							xres->damage.full=true;
+							if(!xecho_layout(config, xres, &worker, blocks, window_width, window_height)){
 								fprintf(stderr, "Block calculation failed\n");
 								abort=-1;
 							}
-							event.type=Expose;
-							XSendEvent(xres->display, xres->main, False, 0, &event);
+							if(!config->layout_thread){
+								redraw=true;
+							}
 							break;
 						default:
 							errlog(config, LOG_DEBUG, "KeyPress %d\n", event.xkey.keycode);
@@ -109,102 +290,165 @@ int xecho(CFG* config, XRESOURCES* xres, char* initial_text){
 					break;
 
 				default:
+					if(config->shm_render&&event.type==xres->shm.completion){
+						//the shared image may be written again
+						xres->shm.pending=false;
+						break;
+					}
 					errlog(config, LOG_INFO, "Unhandled X event\n");
 					break;
 			}
 		}
 
+		//draw right away instead of waiting for a round trip through the server
+		if(redraw&&!abort){
+			redraw=false;
+			if(!xecho_render(config, xres, config->layout_thread?layout:blocks)){
+				abort=-1;
+			}
+		}
+
 		XFlush(xres->display);
 
 		if(abort){
 			break;
 		}
 
-		//prepare select data
-		FD_ZERO(&readfds);
-		maxfd=-1;
-		tv.tv_sec=1;
-		tv.tv_usec=0;
-
-		for(i=0;i<xres->xfds.size;i++){
-			FD_SET(xres->xfds.fds[i], &readfds);
-			if(maxfd<xres->xfds.fds[i]){
-				maxfd=xres->xfds.fds[i];
+		//arm the frame timer for a coalesced update
+		if(update_pending&&!timer_armed){
+			wait=frame_interval-xecho_elapsed(&last_update);
+			memset(&timer, 0, sizeof(timer));
+			timer.it_value.tv_sec=(wait>0)?(wait/1000000000L):0;
+			timer.it_value.tv_nsec=(wait>0)?(wait%1000000000L):1;
+			if(timerfd_settime(timer_fd, 0, &timer, NULL)){
+				perror("timerfd_settime");
+				abort=-1;
+				break;
 			}
+			timer_armed=true;
 		}
 
-		if(config->handle_stdin){
-			FD_SET(fileno(stdin), &readfds);
-			if(maxfd<fileno(stdin)){
-				maxfd=fileno(stdin);
+		//wait for events, there is no idle timeout
+		//events already read into the queue (eg. while waiting for shm completion) never wake the socket
+		error=epoll_wait(epoll_fd, events, EVENT_BATCH, (stdin_always||XEventsQueued(xres->display, QueuedAlready))?0:-1);
+		if(error<0){
+			perror("epoll_wait");
+			abort=-1;
+			break;
+		}
+
+		stdin_ready=stdin_always;
+		worker_ready=false;
+		resize_ready=false;
+		for(n=0;n<error;n++){
+			if(events[n].data.fd==fileno(stdin)){
+				stdin_ready=true;
+			}
+			else if(config->layout_thread&&events[n].data.fd==worker.notify[0]){
+				worker_ready=true;
 			}
+			else if(events[n].data.fd==timer_fd){
+				if(read(timer_fd, &expirations, sizeof(expirations))<0&&errno!=EAGAIN){
+					perror("timerfd");
+				}
+				timer_armed=false;
+			}
+			else if(events[n].data.fd==resize_fd){
+				if(read(resize_fd, &expirations, sizeof(expirations))<0&&errno!=EAGAIN){
+					perror("timerfd");
+				}
+				resize_ready=true;
+			}
+			else if(events[n].data.fd==signal_fd){
+				if(read(signal_fd, &signal_info, sizeof(signal_info))==sizeof(signal_info)){
+					errlog(config, LOG_INFO, "Caught signal %d, shutting down\n", signal_info.ssi_signo);
+					abort=1;
+				}
+			}
+			//x connection activity is handled at the top of the loop
 		}
 
-		error=select(maxfd+1, &readfds, NULL, NULL, &tv);
-		if(error>0){
-			if(FD_ISSET(fileno(stdin), &readfds)){
-				//handle stdin input
-				errlog(config, LOG_INFO, "Data on stdin\n");
+		if(!abort){
+			if(resize_ready&&resize_pending){
+				resize_pending=false;
+				if(window_width!=resize_width||window_height!=resize_height){
+					window_width=resize_width;
+					window_height=resize_height;
+					if(!xecho_resize(config, xres, &worker, blocks, window_width, window_height)){
+						abort=-1;
+					}
+					if(!config->layout_thread){
+						redraw=true;
+					}
+				}
+			}
 
-				do{
-					display_buffer_offset=strlen(display_buffer);
-					errlog(config, LOG_DEBUG, "Display buffer is %d long, offset is %d\n", display_buffer_length, display_buffer_offset);
-					if(display_buffer_length-display_buffer_offset<STDIN_DATA_CHUNK){
-						//reallocate
-						display_buffer_length+=STDIN_DATA_CHUNK;
-						display_buffer=realloc(display_buffer, display_buffer_length*sizeof(char));
-						if(!display_buffer){
-							fprintf(stderr, "Failed to reallocate display data buffer\n");
+			if(worker_ready){
+				//adopt finished layout
+				switch(worker_collect(&worker, blocks, &layout)){
+					case 1:
+						errlog(config, LOG_DEBUG, "Adopting layout from worker\n");
+						if(!x11_place_blocks(config, xres, layout, window_width, window_height, worker.config.metrics)){
+							fprintf(stderr, "Block placement failed\n");
 							abort=-1;
 						}
-						errlog(config, LOG_DEBUG, "Reallocated display buffer to %d bytes\n", display_buffer_length);
-					}
+						redraw=true;
+						break;
+					case -1:
+						fprintf(stderr, "Block calculation failed\n");
+						abort=-1;
+						break;
+				}
+			}
 
-					//read data
-					error=read(fileno(stdin),
-							display_buffer+display_buffer_offset,
-							display_buffer_length-1-display_buffer_offset
-						  );
+			if(config->handle_stdin&&stdin_ready){
+				//handle stdin input
+				errlog(config, LOG_INFO, "Data on stdin\n");
 
+				reads=0;
+				committed=false;
+				do{
+					//read data
+					error=read(fileno(stdin), stdin_buffer, stdin_buffer_length);
 					errlog(config, LOG_DEBUG, "Read %d bytes from stdin\n", error);
+					reads++;
 
-					//terminate string
-					if(error>0){
-						display_buffer[display_buffer_offset+error]=0;
+					//only the new bytes of committed frames are parsed, changed lines are marked dirty
+					if(error>0&&!string_stream_input(&stream, stdin_buffer, error, config->drain_input, &(xres->stats.frames_dropped), &committed)){
+						fprintf(stderr, "Failed to blockify updated input\n");
+						abort=-1;
+						break;
 					}
 
-				}while(error>0);
+					//bound the work per wakeup when draining, the rest is picked up next round
+				}while(error>0&&(!config->drain_input||reads<STDIN_DRAIN_READS));
 
-				//check if stdin was closed
+				//check if stdin was closed, the last frame needs no delimiter
 				if(error==0){
 					config->handle_stdin=false;
+					stdin_always=false;
+					epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fileno(stdin), NULL);
+					if(stream.held_length){
+						if(!string_stream_flush(&stream)){
+							fprintf(stderr, "Failed to blockify updated input\n");
+							abort=-1;
+						}
+						committed=true;
+					}
 				}
 				
-				switch(errno){
+				switch((error<0)?errno:EAGAIN){
 					case EAGAIN:
 						//would block, so done reading
-						//preprocess input data to filter control codes
-						if(!string_preprocess(display_buffer, false)){
-							fprintf(stderr, "Failed to preprocess input text\n");
-							abort=-1;
-						}
-						errlog(config, LOG_INFO, "Updated display text to\n\"%s\"\n", display_buffer);
-
-						//blockify
-						if(!string_blockify(&blocks, display_buffer)){
-							fprintf(stderr, "Failed to blockify updated input\n");
-							abort=-1;
+						if(!committed){
+							errlog(config, LOG_DEBUG, "Holding %d bytes of an incomplete frame\n", stream.held_length);
+							break;
 						}
+						blocks=string_stream_view(&stream);
+						errlog(config, LOG_INFO, "Updated display text, now %d lines in %lu bytes\n", stream.lines, stream.bytes);
 
-						//recalculate
-						if(!x11_recalculate_blocks(config, xres, blocks, window_width, window_height)){
-							fprintf(stderr, "Block calculation failed\n");
-							abort=-1;
-						}
-						
-						//update display
-						event.type=Expose;
-						XSendEvent(xres->display, xres->main, False, 0, &event);
+						//layout is run once per frame interval
+						update_pending=true;
 						break;
 					default:
 						fprintf(stderr, "Failed to read stdin\n");
@@ -212,27 +456,67 @@ int xecho(CFG* config, XRESOURCES* xres, char* initial_text){
 				}
 			}
 		}
-		else if(error<0){
-			perror("select");
-			abort=-1;
+
+		if(update_pending&&!abort&&xecho_elapsed(&last_update)>=frame_interval){
+			update_pending=false;
+			clock_gettime(CLOCK_MONOTONIC, &last_update);
+
+			//recalculate
+			if(!xecho_layout(config, xres, &worker, blocks, window_width, window_height)){
+				fprintf(stderr, "Block calculation failed\n");
+				abort=-1;
+			}
+
+			//update display, the worker result is drawn when adopted
+			if(!config->layout_thread){
+				redraw=true;
+			}
 		}
 	}
 
+	//tear down the event loop, the x connection may still close fds
+	xres->xfds.epoll=-1;
+	if(epoll_fd>=0){
+		close(epoll_fd);
+	}
+	if(timer_fd>=0){
+		close(timer_fd);
+	}
+	if(resize_fd>=0){
+		close(resize_fd);
+	}
+	if(signal_fd>=0){
+		close(signal_fd);
+	}
+
+	worker_stop(&worker);
+	pool_stop(&pool);
+	xres->pool=NULL;
+	errlog(config, LOG_INFO, "Layout statistics: %lu maximizer passes, %lu size probes, %lu ms\n", xres->stats.layout_passes, xres->stats.layout_probes, xres->stats.layout_ns/1000000L);
+	if(xres->stats.frames_drawn){
+		//xft rasterizes in the server, count what is still queued there
+		XSync(xres->display, False);
+		elapsed=xecho_elapsed(&(xres->stats.first_frame))/1000000L;
+		errlog(config, LOG_INFO, "Render statistics: %lu frames in %ld ms, %.1f fps (%s)\n", xres->stats.frames_drawn, elapsed, elapsed?(xres->stats.frames_drawn*1000.0/elapsed):0.0, config->shm_render?"MIT-SHM":"Xft");
+	}
+	if(config->drain_input){
+		errlog(config, LOG_INFO, "Input statistics: %lu frames dropped\n", xres->stats.frames_dropped);
+	}
+	if(config->layout_thread){
+		errlog(config, LOG_INFO, "Layout worker statistics: %lu maximizer passes, %lu size probes, %lu cancelled layouts\n", worker.res.stats.layout_passes, worker.res.stats.layout_probes, worker.res.stats.layouts_cancelled);
+	}
+
 	//free data
-	if(display_buffer){
-		free(display_buffer);
+	free(stdin_buffer);
+
+	//free blocks structures, stdin lines are owned by the stream
+	if(stream.ring){
+		string_stream_free(&stream);
 	}
-	
-	if(blocks){
-		//free blocks structure
-		for(i=0;blocks[i];i++){
-			if(blocks[i]->text){
-				free(blocks[i]->text);
-			}
-			free(blocks[i]);
-		}
-		free(blocks);
+	else{
+		string_blocks_free(blocks);
 	}
+	string_blocks_free(layout);
 
 	return abort;
 }
@@ -0,0 +1,215 @@
+bool glyphs_load(GLYPH_TABLE* table, FcChar32 codepoint, GLYPH_METRICS* glyph){
+	FT_Glyph_Metrics* outline;
+	FT_UInt index;
+	XGlyphInfo info;
+
+	if(table->face){
+		//unscaled and unhinted, in font units
+		index=FT_Get_Char_Index(table->face, codepoint);
+		if(FT_Load_Glyph(table->face, index, FT_LOAD_NO_SCALE | FT_LOAD_NO_HINTING | FT_LOAD_NO_BITMAP)){
+			fprintf(stderr, "Failed to load outline for codepoint %d\n", codepoint);
+			return false;
+		}
+		outline=&(table->face->glyph->metrics);
+		glyph->ink_left=outline->horiBearingX;
+		glyph->ink_right=outline->horiBearingX+outline->width;
+		glyph->ink_top=outline->horiBearingY;
+		glyph->ink_bottom=outline->horiBearingY-outline->height;
+		glyph->advance=outline->horiAdvance;
+	}
+	else{
+		//rasterized by xft, in pixels
+		index=XftCharIndex(table->display, table->font, codepoint);
+		XftGlyphExtents(table->display, table->font, &index, 1, &info);
+		glyph->ink_left=-info.x;
+		glyph->ink_right=-info.x+info.width;
+		glyph->ink_top=info.y;
+		glyph->ink_bottom=info.y-info.height;
+		glyph->advance=info.xOff;
+	}
+
+	glyph->codepoint=codepoint;
+	glyph->index=index;
+	glyph->valid=true;
+	return true;
+}
+
+GLYPH_METRICS* glyphs_get(GLYPH_TABLE* table, FcChar32 codepoint){
+	unsigned i, c, mask, old_size;
+	GLYPH_METRICS* old_sparse;
+
+	//latin-1 is stored densely
+	if(codepoint<GLYPH_DENSE_RANGE){
+		if(!table->dense){
+			table->dense=calloc(GLYPH_DENSE_RANGE, sizeof(GLYPH_METRICS));
+			if(!table->dense){
+				fprintf(stderr, "Failed to allocate memory\n");
+				return NULL;
+			}
+		}
+		if(!table->dense[codepoint].valid&&!glyphs_load(table, codepoint, table->dense+codepoint)){
+			return NULL;
+		}
+		return table->dense+codepoint;
+	}
+
+	//everything else goes to an open addressed hash
+	if(table->sparse_size){
+		mask=table->sparse_size-1;
+		for(i=(codepoint*2654435761u)&mask;table->sparse[i].valid;i=(i+1)&mask){
+			if(table->sparse[i].codepoint==codepoint){
+				return table->sparse+i;
+			}
+		}
+	}
+
+	//keep the hash at most half full
+	if(2*(table->sparse_used+1)>table->sparse_size){
+		old_sparse=table->sparse;
+		old_size=table->sparse_size;
+
+		table->sparse_size=(old_size>0)?(2*old_size):GLYPH_SPARSE_INITIAL;
+		table->sparse=calloc(table->sparse_size, sizeof(GLYPH_METRICS));
+		if(!table->sparse){
+			fprintf(stderr, "Failed to allocate memory\n");
+			table->sparse=old_sparse;
+			table->sparse_size=old_size;
+			return NULL;
+		}
+
+		mask=table->sparse_size-1;
+		for(c=0;c<old_size;c++){
+			if(old_sparse[c].valid){
+				for(i=(old_sparse[c].codepoint*2654435761u)&mask;table->sparse[i].valid;i=(i+1)&mask){
+				}
+				table->sparse[i]=old_sparse[c];
+			}
+		}
+		free(old_sparse);
+	}
+
+	mask=table->sparse_size-1;
+	for(i=(codepoint*2654435761u)&mask;table->sparse[i].valid;i=(i+1)&mask){
+	}
+
+	if(!glyphs_load(table, codepoint, table->sparse+i)){
+		return NULL;
+	}
+	table->sparse_used++;
+	return table->sparse+i;
+}
+
+void glyphs_free(GLYPH_TABLE* table){
+	free(table->dense);
+	free(table->sparse);
+	table->dense=NULL;
+	table->sparse=NULL;
+	table->sparse_size=0;
+	table->sparse_used=0;
+}
+
+bool glyphs_text_extents(GLYPH_TABLE* table, double scale, char* text, XGlyphInfo* extents){
+	unsigned offset=0, length=strlen(text);
+	int consumed;
+	FcChar32 codepoint;
+	GLYPH_METRICS* glyph;
+	long pen=0;
+	long ink_left=0, ink_right=0, ink_top=0, ink_bottom=0;
+	bool first=true;
+
+	//union of all glyph boxes along the pen, the same way xft does it
+	while(offset<length){
+		if((unsigned char)text[offset]<0x80){
+			codepoint=text[offset];
+			consumed=1;
+		}
+		else{
+			consumed=FcUtf8ToUcs4((FcChar8*)text+offset, &codepoint, length-offset);
+			if(consumed<=0){
+				break;
+			}
+		}
+		offset+=consumed;
+
+		glyph=glyphs_get(table, codepoint);
+		if(!glyph){
+			return false;
+		}
+
+		if(first||pen+glyph->ink_left<ink_left){
+			ink_left=pen+glyph->ink_left;
+		}
+		if(first||pen+glyph->ink_right>ink_right){
+			ink_right=pen+glyph->ink_right;
+		}
+		if(first||glyph->ink_top>ink_top){
+			ink_top=glyph->ink_top;
+		}
+		if(first||glyph->ink_bottom<ink_bottom){
+			ink_bottom=glyph->ink_bottom;
+		}
+		first=false;
+
+		pen+=glyph->advance;
+	}
+
+	//round outward so the box always covers the ink
+	extents->x=-floor(ink_left*scale);
+	extents->y=ceil(ink_top*scale);
+	extents->width=ceil(ink_right*scale)-floor(ink_left*scale);
+	extents->height=ceil(ink_top*scale)-floor(ink_bottom*scale);
+	extents->xOff=round(pen*scale);
+	extents->yOff=0;
+	return true;
+}
+
+void metrics_free(METRICS* metrics){
+	glyphs_free(&(metrics->glyphs));
+	if(metrics->glyphs.face){
+		FT_Done_Face(metrics->glyphs.face);
+		metrics->glyphs.face=NULL;
+	}
+	if(metrics->library){
+		FT_Done_FreeType(metrics->library);
+		metrics->library=NULL;
+	}
+}
+
+bool metrics_init(METRICS* metrics, FcPattern* pattern, CFG* config){
+	FcChar8* file=NULL;
+	int index=0;
+
+	if(FcPatternGetString(pattern, FC_FILE, 0, &file)!=FcResultMatch){
+		errlog(config, LOG_INFO, "Font pattern has no file, outline metrics unavailable\n");
+		return false;
+	}
+	FcPatternGetInteger(pattern, FC_INDEX, 0, &index);
+
+	if(FT_Init_FreeType(&(metrics->library))){
+		fprintf(stderr, "Failed to initialize FreeType\n");
+		metrics->library=NULL;
+		return false;
+	}
+
+	if(FT_New_Face(metrics->library, (char*)file, index, &(metrics->glyphs.face))){
+		fprintf(stderr, "Failed to open font face %s\n", file);
+		metrics->glyphs.face=NULL;
+		metrics_free(metrics);
+		return false;
+	}
+
+	if(!FT_IS_SCALABLE(metrics->glyphs.face)){
+		errlog(config, LOG_INFO, "Font face %s is not scalable, outline metrics unavailable\n", file);
+		metrics_free(metrics);
+		return false;
+	}
+
+	metrics->units_per_em=metrics->glyphs.face->units_per_EM;
+	errlog(config, LOG_INFO, "Outline metrics from %s (%d units per em)\n", file, (int)metrics->units_per_em);
+	return true;
+}
+
+bool metrics_text_extents(METRICS* metrics, double size, char* text, XGlyphInfo* extents){
+	//outline metrics scale linearly, one table serves all sizes
+	return glyphs_text_extents(&(metrics->glyphs), size/metrics->units_per_em, text, extents);
+}
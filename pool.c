@@ -0,0 +1,132 @@
+void pool_work(MEASURE_POOL* pool, METRICS* metrics){
+	unsigned i;
+
+	//claim lines until the batch is exhausted
+	for(i=atomic_fetch_add(&(pool->next), 1);i<pool->count;i=atomic_fetch_add(&(pool->next), 1)){
+		if(pool->blocks[i]->calculated||(!pool->blocks[i]->dirty&&pool->blocks[i]->size==pool->size)){
+			continue;
+		}
+		if(!metrics_text_extents(metrics, pool->size, pool->blocks[i]->text, &(pool->blocks[i]->extents))){
+			atomic_store(&(pool->failed), true);
+		}
+	}
+}
+
+void* pool_main(void* data){
+	MEASURE_THREAD* thread=(MEASURE_THREAD*)data;
+	MEASURE_POOL* pool=thread->pool;
+	unsigned long batch=0;
+
+	pthread_mutex_lock(&(pool->lock));
+	while(!pool->shutdown){
+		if(batch==pool->batch){
+			pthread_cond_wait(&(pool->start), &(pool->lock));
+			continue;
+		}
+		batch=pool->batch;
+		pthread_mutex_unlock(&(pool->lock));
+
+		pool_work(pool, &(thread->metrics));
+
+		pthread_mutex_lock(&(pool->lock));
+		pool->pending--;
+		if(!pool->pending){
+			pthread_cond_signal(&(pool->finished));
+		}
+	}
+	pthread_mutex_unlock(&(pool->lock));
+
+	return NULL;
+}
+
+bool pool_measure(MEASURE_POOL* pool, METRICS* metrics, TEXTBLOCK** blocks, double size){
+	unsigned count;
+
+	for(count=0;blocks[count]&&blocks[count]->active;count++){
+	}
+
+	//publish the batch
+	pthread_mutex_lock(&(pool->lock));
+	pool->blocks=blocks;
+	pool->count=count;
+	pool->size=size;
+	atomic_store(&(pool->next), 0);
+	atomic_store(&(pool->failed), false);
+	pool->pending=pool->num_threads;
+	pool->batch++;
+	pthread_cond_broadcast(&(pool->start));
+	pthread_mutex_unlock(&(pool->lock));
+
+	//the calling thread measures too, with its own face
+	pool_work(pool, metrics);
+
+	pthread_mutex_lock(&(pool->lock));
+	while(pool->pending){
+		pthread_cond_wait(&(pool->finished), &(pool->lock));
+	}
+	pthread_mutex_unlock(&(pool->lock));
+
+	return !atomic_load(&(pool->failed));
+}
+
+void pool_stop(MEASURE_POOL* pool){
+	unsigned i;
+
+	if(!pool->threads){
+		return;
+	}
+
+	pthread_mutex_lock(&(pool->lock));
+	pool->shutdown=true;
+	pthread_cond_broadcast(&(pool->start));
+	pthread_mutex_unlock(&(pool->lock));
+
+	for(i=0;i<pool->num_threads;i++){
+		pthread_join(pool->threads[i].thread, NULL);
+		metrics_free(&(pool->threads[i].metrics));
+	}
+
+	pthread_cond_destroy(&(pool->start));
+	pthread_cond_destroy(&(pool->finished));
+	pthread_mutex_destroy(&(pool->lock));
+	free(pool->threads);
+	pool->threads=NULL;
+	pool->num_threads=0;
+}
+
+bool pool_start(MEASURE_POOL* pool, CFG* config, FcPattern* pattern){
+	unsigned i;
+
+	//the caller measures as well, so one thread less is started
+	pool->threads=calloc(config->measure_threads-1, sizeof(MEASURE_THREAD));
+	if(!pool->threads){
+		fprintf(stderr, "Failed to allocate memory\n");
+		return false;
+	}
+
+	pthread_mutex_init(&(pool->lock), NULL);
+	pthread_cond_init(&(pool->start), NULL);
+	pthread_cond_init(&(pool->finished), NULL);
+
+	for(i=0;i<config->measure_threads-1;i++){
+		pool->threads[i].pool=pool;
+		if(!metrics_init(&(pool->threads[i].metrics), pattern, config)){
+			fprintf(stderr, "Measurement threads need a scalable font\n");
+			break;
+		}
+		if(pthread_create(&(pool->threads[i].thread), NULL, pool_main, pool->threads+i)){
+			fprintf(stderr, "Failed to start measurement thread\n");
+			metrics_free(&(pool->threads[i].metrics));
+			break;
+		}
+		pool->num_threads++;
+	}
+
+	if(pool->num_threads<config->measure_threads-1){
+		pool_stop(pool);
+		return false;
+	}
+
+	errlog(config, LOG_INFO, "Started %d measurement threads\n", pool->num_threads);
+	return true;
+}
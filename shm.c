@@ -0,0 +1,311 @@
+//the error handler has no user data, attach failures are reported here
+int shm_attach_error=Success;
+
+int shm_attach_handler(Display* display, XErrorEvent* error){
+	shm_attach_error=error->error_code;
+	return 0;
+}
+
+bool shm_init(XRESOURCES* xres, CFG* config){
+	char* display_name=DisplayString(xres->display);
+	Visual* visual=DefaultVisual(xres->display, xres->screen);
+
+	if(!XShmQueryExtension(xres->display)){
+		errlog(config, LOG_INFO, "MIT-SHM not available, rendering via Xft\n");
+		return false;
+	}
+
+	//segments can only be shared with a server on the same host
+	if(display_name[0]!=':'&&strncmp(display_name, "unix:", 5)){
+		errlog(config, LOG_INFO, "Display %s is not local, rendering via Xft\n", display_name);
+		return false;
+	}
+
+	//the blitter writes 8 bit channels into 32 bit pixels
+	if(DefaultDepth(xres->display, xres->screen)<24
+			|| visual->red_mask!=0xFF0000
+			|| visual->green_mask!=0xFF00
+			|| visual->blue_mask!=0xFF){
+		errlog(config, LOG_INFO, "Unsupported visual for client side rendering, rendering via Xft\n");
+		return false;
+	}
+
+	if(!metrics_init(&(xres->shm.raster), xres->font_pattern, config)){
+		errlog(config, LOG_INFO, "Client side rendering needs a scalable font, rendering via Xft\n");
+		return false;
+	}
+
+	xres->shm.completion=XShmGetEventBase(xres->display)+ShmCompletion;
+	errlog(config, LOG_INFO, "Rendering client side via MIT-SHM\n");
+	return true;
+}
+
+void shm_release(XRESOURCES* xres){
+	if(!xres->shm.image){
+		return;
+	}
+
+	//requests are ordered, a pending put completes before the detach
+	XShmDetach(xres->display, &(xres->shm.segment));
+	xres->shm.image->data=NULL;
+	XDestroyImage(xres->shm.image);
+	shmdt(xres->shm.segment.shmaddr);
+	xres->shm.image=NULL;
+	xres->shm.pending=false;
+}
+
+void shm_free(XRESOURCES* xres){
+	shm_release(xres);
+	metrics_free(&(xres->shm.raster));
+}
+
+bool shm_resize(XRESOURCES* xres, CFG* config, unsigned width, unsigned height){
+	SHM_TARGET* shm=&(xres->shm);
+	XErrorHandler handler;
+
+	shm_release(xres);
+
+	shm->image=XShmCreateImage(xres->display, DefaultVisual(xres->display, xres->screen), DefaultDepth(xres->display, xres->screen), ZPixmap, NULL, &(shm->segment), width, height);
+	if(!shm->image){
+		fprintf(stderr, "Failed to create shared image\n");
+		return false;
+	}
+	if(shm->image->bits_per_pixel!=32){
+		fprintf(stderr, "Shared image has %d bits per pixel, need 32\n", shm->image->bits_per_pixel);
+		XDestroyImage(shm->image);
+		shm->image=NULL;
+		return false;
+	}
+
+	shm->segment.shmid=shmget(IPC_PRIVATE, shm->image->bytes_per_line*shm->image->height, IPC_CREAT | 0600);
+	if(shm->segment.shmid<0){
+		perror("shmget");
+		XDestroyImage(shm->image);
+		shm->image=NULL;
+		return false;
+	}
+
+	shm->segment.shmaddr=shmat(shm->segment.shmid, NULL, 0);
+	if(shm->segment.shmaddr==(char*)-1){
+		perror("shmat");
+		shmctl(shm->segment.shmid, IPC_RMID, NULL);
+		XDestroyImage(shm->image);
+		shm->image=NULL;
+		return false;
+	}
+	shm->image->data=shm->segment.shmaddr;
+	shm->segment.readOnly=False;
+
+	//a local display may still not share our ipc namespace (eg. containers)
+	shm_attach_error=Success;
+	handler=XSetErrorHandler(shm_attach_handler);
+	XShmAttach(xres->display, &(shm->segment));
+	XSync(xres->display, False);
+	XSetErrorHandler(handler);
+
+	//the segment is removed once both sides detached
+	shmctl(shm->segment.shmid, IPC_RMID, NULL);
+
+	if(shm_attach_error!=Success){
+		fprintf(stderr, "Server failed to attach shared image (error %d)\n", shm_attach_error);
+		shm->image->data=NULL;
+		XDestroyImage(shm->image);
+		shmdt(shm->segment.shmaddr);
+		shm->image=NULL;
+		return false;
+	}
+
+	errlog(config, LOG_DEBUG, "Allocated %dx%d shared image\n", width, height);
+	return true;
+}
+
+Bool shm_completed(Display* display, XEvent* event, XPointer data){
+	return event->type==((SHM_TARGET*)data)->completion;
+}
+
+void shm_wait(XRESOURCES* xres){
+	XEvent event;
+
+	//the server may still be reading the last frame from the segment
+	if(xres->shm.pending){
+		XIfEvent(xres->display, &event, shm_completed, (XPointer)&(xres->shm));
+		xres->shm.pending=false;
+	}
+}
+
+bool shm_clip(XImage* image, XRectangle* rect, XRectangle* area, int* x0, int* y0, int* x1, int* y1){
+	*x0=rect->x;
+	*y0=rect->y;
+	*x1=rect->x+rect->width;
+	*y1=rect->y+rect->height;
+
+	if(area){
+		*x0=(area->x>*x0)?area->x:*x0;
+		*y0=(area->y>*y0)?area->y:*y0;
+		*x1=(area->x+area->width<*x1)?(area->x+area->width):*x1;
+		*y1=(area->y+area->height<*y1)?(area->y+area->height):*y1;
+	}
+
+	*x0=(*x0<0)?0:*x0;
+	*y0=(*y0<0)?0:*y0;
+	*x1=(*x1>image->width)?image->width:*x1;
+	*y1=(*y1>image->height)?image->height:*y1;
+	return *x0<*x1&&*y0<*y1;
+}
+
+void shm_fill(XImage* image, XRectangle* rect, XRectangle* area, unsigned long pixel){
+	int x, y, x0, y0, x1, y1;
+	uint32_t* row;
+
+	if(!shm_clip(image, rect, area, &x0, &y0, &x1, &y1)){
+		return;
+	}
+
+	for(y=y0;y<y1;y++){
+		row=(uint32_t*)(image->data+y*image->bytes_per_line);
+		for(x=x0;x<x1;x++){
+			row[x]=pixel;
+		}
+	}
+}
+
+bool shm_covered(XRectangle* rects, unsigned num_rects, int x, int y){
+	unsigned i;
+
+	for(i=0;i<num_rects;i++){
+		if(x>=rects[i].x&&x<rects[i].x+rects[i].width
+				&& y>=rects[i].y&&y<rects[i].y+rects[i].height){
+			return true;
+		}
+	}
+	return false;
+}
+
+void shm_blend(XImage* image, FT_Bitmap* bitmap, int left, int top, XRectangle* rects, unsigned rect, XftColor* color){
+	int x, y, x0, y0, x1, y1;
+	unsigned alpha, red=color->color.red>>8, green=color->color.green>>8, blue=color->color.blue>>8;
+	uint32_t* row;
+	uint32_t dest;
+	unsigned char* coverage;
+	XRectangle glyph={left, top, bitmap->width, bitmap->rows};
+
+	if(!shm_clip(image, rects+rect, &glyph, &x0, &y0, &x1, &y1)){
+		return;
+	}
+
+	//coverage over the destination, per 8 bit channel
+	//damage rects overlap, pixels of earlier rects are already blended
+	for(y=y0;y<y1;y++){
+		row=(uint32_t*)(image->data+y*image->bytes_per_line);
+		coverage=bitmap->buffer+(y-top)*bitmap->pitch-left;
+		for(x=x0;x<x1;x++){
+			alpha=coverage[x];
+			if(!alpha||(rect&&shm_covered(rects, rect, x, y))){
+				continue;
+			}
+			dest=row[x];
+			row[x]=(((((dest>>16)&0xFF)*(255-alpha)+red*alpha)/255)<<16)
+				| (((((dest>>8)&0xFF)*(255-alpha)+green*alpha)/255)<<8)
+				| ((((dest&0xFF)*(255-alpha)+blue*alpha)/255));
+		}
+	}
+}
+
+bool shm_draw_block(XRESOURCES* xres, CFG* config, TEXTBLOCK* block, XRectangle* rects, unsigned num_rects){
+	FT_Face face=xres->shm.raster.glyphs.face;
+	unsigned offset=0, length=strlen(block->text), i;
+	int consumed;
+	long pen=((long)block->layout_x+block->extents.x)*64;
+	int baseline=block->layout_y+block->extents.y;
+	FcChar32 codepoint;
+
+	//fractional pixel sizes, as for xft
+	if(FT_Set_Char_Size(face, 0, (FT_F26Dot6)(block->size*64), 72, 72)){
+		fprintf(stderr, "Failed to size face to %f\n", block->size);
+		return false;
+	}
+
+	while(offset<length){
+		if((unsigned char)block->text[offset]<0x80){
+			codepoint=block->text[offset];
+			consumed=1;
+		}
+		else{
+			consumed=FcUtf8ToUcs4((FcChar8*)block->text+offset, &codepoint, length-offset);
+			if(consumed<=0){
+				break;
+			}
+		}
+		offset+=consumed;
+
+		if(FT_Load_Char(face, codepoint, FT_LOAD_RENDER)){
+			errlog(config, LOG_DEBUG, "Failed to render codepoint %d\n", codepoint);
+			continue;
+		}
+
+		if(face->glyph->bitmap.pixel_mode==FT_PIXEL_MODE_GRAY){
+			for(i=0;i<num_rects;i++){
+				shm_blend(xres->shm.image, &(face->glyph->bitmap), ((pen+32)>>6)+face->glyph->bitmap_left, baseline-face->glyph->bitmap_top, rects, i, &(xres->text_color));
+			}
+		}
+		pen+=face->glyph->advance.x;
+	}
+
+	return true;
+}
+
+bool shm_draw_frame(XRESOURCES* xres, CFG* config, TEXTBLOCK** blocks, unsigned num_blocks, bool full){
+	XRectangle frame={0, 0, xres->shm.image->width, xres->shm.image->height};
+	XRectangle* rects=full?&frame:xres->damage.rects;
+	unsigned num_rects=full?1:xres->damage.num_rects;
+	unsigned i, r, last=0;
+	int x0, y0, x1, y1;
+	XRectangle box;
+
+	shm_wait(xres);
+
+	//the image is retained like the back buffer, clear only the damage
+	for(r=0;r<num_rects;r++){
+		shm_fill(xres->shm.image, rects+r, NULL, xres->bg_color.pixel);
+	}
+
+	if(config->debug_boxes){
+		for(i=0;i<num_blocks;i++){
+			if(blocks[i]->damaged){
+				box.x=blocks[i]->layout_x;
+				box.y=blocks[i]->layout_y;
+				box.width=blocks[i]->extents.width;
+				box.height=blocks[i]->extents.height;
+				for(r=0;r<num_rects;r++){
+					shm_fill(xres->shm.image, rects+r, &box, xres->debug_color.pixel);
+				}
+			}
+		}
+	}
+
+	for(i=0;i<num_blocks&&!config->disable_text;i++){
+		if(blocks[i]->damaged&&blocks[i]->text[0]
+				&& !shm_draw_block(xres, config, blocks[i], rects, num_rects)){
+			return false;
+		}
+	}
+
+	//damage may reach past the window, puts must stay inside the image
+	xres->shm.pending=false;
+	for(r=0;r<num_rects;r++){
+		if(shm_clip(xres->shm.image, rects+r, NULL, &x0, &y0, &x1, &y1)){
+			last=r;
+			xres->shm.pending=true;
+		}
+	}
+
+	//only the last put reports completion
+	for(r=0;r<num_rects;r++){
+		if(shm_clip(xres->shm.image, rects+r, NULL, &x0, &y0, &x1, &y1)){
+			XShmPutImage(xres->display, config->double_buffer?xres->back_buffer:xres->main, xres->copy_gc, xres->shm.image,
+					x0, y0, x0, y0, x1-x0, y1-y0, r==last);
+		}
+	}
+
+	return true;
+}
@@ -58,6 +58,11 @@ bool string_preprocess(char* input, bool handle_escapes){
 }
 
 bool string_block_store(TEXTBLOCK* block, char* stream, unsigned length){
+	if(block->text&&block->length==length&&!strncmp(block->text, stream, length)){
+		block->active=true;
+		return true;
+	}
+
 	block->text=realloc(block->text, (length+1)*sizeof(char));
 	if(!(block->text)){
 		fprintf(stderr, "Failed to allocate memory\n");
@@ -67,10 +72,434 @@ bool string_block_store(TEXTBLOCK* block, char* stream, unsigned length){
 	strncpy(block->text, stream, length);
 	(block->text)[length]=0;
 
+	block->length=length;
+	block->capacity=length+1;
 	block->active=true;
+	block->dirty=true;
+	block->damaged=true;
+	return true;
+}
+
+bool string_block_append(TEXTBLOCK* block, char* stream, unsigned length){
+	unsigned capacity=block->capacity?block->capacity:TEXTBLOCK_INITIAL;
+
+	for(;capacity<block->length+length+1;capacity*=2){
+	}
+
+	if(capacity!=block->capacity){
+		block->text=realloc(block->text, capacity*sizeof(char));
+		if(!(block->text)){
+			fprintf(stderr, "Failed to allocate memory\n");
+			return false;
+		}
+		block->capacity=capacity;
+	}
+
+	strncpy(block->text+block->length, stream, length);
+	block->length+=length;
+	(block->text)[block->length]=0;
+
+	block->dirty=true;
+	block->damaged=true;
+	return true;
+}
+
+void string_block_clear(TEXTBLOCK* block){
+	if(block->length){
+		block->length=0;
+		(block->text)[0]=0;
+		block->dirty=true;
+		block->damaged=true;
+	}
+}
+
+TEXTBLOCK* string_stream_current(STRING_STREAM* stream){
+	return stream->ring[(stream->first+stream->lines-1)%stream->ring_size];
+}
+
+void string_stream_clear(STRING_STREAM* stream, TEXTBLOCK* block){
+	stream->bytes-=block->length;
+	string_block_clear(block);
+}
+
+void string_stream_evict(STRING_STREAM* stream){
+	//the oldest record stays allocated in its slot for reuse
+	string_stream_clear(stream, stream->ring[stream->first]);
+	stream->first=(stream->first+1)%stream->ring_size;
+	stream->lines--;
+}
+
+bool string_stream_grow(STRING_STREAM* stream){
+	unsigned i, size=stream->ring_size?(2*stream->ring_size):STREAM_RING_INITIAL;
+	TEXTBLOCK** ring;
+	TEXTBLOCK** view;
+
+	if(stream->max_lines&&size>stream->max_lines+1){
+		size=stream->max_lines+1;
+	}
+
+	//the view holds every line plus a terminator
+	ring=calloc(size, sizeof(TEXTBLOCK*));
+	view=calloc(size+1, sizeof(TEXTBLOCK*));
+	if(!ring||!view){
+		fprintf(stderr, "Failed to allocate memory\n");
+		free(ring);
+		free(view);
+		return false;
+	}
+
+	//unwrap the old ring
+	for(i=0;i<stream->ring_size;i++){
+		ring[i]=stream->ring[(stream->first+i)%stream->ring_size];
+	}
+	for(;i<size;i++){
+		ring[i]=calloc(1, sizeof(TEXTBLOCK));
+		//empty lines are displayed, so they need a text
+		if(!ring[i]||!string_block_append(ring[i], "", 0)){
+			break;
+		}
+	}
+
+	if(i<size){
+		fprintf(stderr, "Failed to allocate memory\n");
+		for(i=stream->ring_size;i<size;i++){
+			if(ring[i]){
+				free(ring[i]->text);
+			}
+			free(ring[i]);
+		}
+		free(ring);
+		free(view);
+		return false;
+	}
+
+	free(stream->ring);
+	free(stream->view);
+	stream->ring=ring;
+	stream->view=view;
+	stream->ring_size=size;
+	stream->first=0;
+	return true;
+}
+
+bool string_stream_compact(STRING_STREAM* stream){
+	unsigned i, size=STREAM_RING_INITIAL, length=0;
+	TEXTBLOCK** ring;
+	TEXTBLOCK* block;
+
+	//track what recent frames needed
+	for(i=0;i<stream->lines;i++){
+		block=stream->ring[(stream->first+i)%stream->ring_size];
+		length=(block->length>length)?block->length:length;
+	}
+	stream->peak_lines=(stream->lines>stream->peak_lines/2)?stream->lines:(stream->peak_lines/2);
+	stream->peak_length=(length>stream->peak_length/2)?length:(stream->peak_length/2);
+
+	//drop all lines, restarting at the first record keeps every
+	//display line on the record (and drawn state) it had last frame
+	for(i=0;i<stream->lines;i++){
+		string_stream_clear(stream, stream->ring[(stream->first+i)%stream->ring_size]);
+	}
+	stream->lines=1;
+
+	//give back line buffers that grew well beyond recent use
+	for(i=0;i<stream->ring_size;i++){
+		block=stream->ring[i];
+		if(block->capacity>STDIN_DATA_CHUNK&&block->capacity>4*stream->peak_length){
+			block->text=realloc(block->text, TEXTBLOCK_INITIAL*sizeof(char));
+			if(!block->text){
+				fprintf(stderr, "Failed to allocate memory\n");
+				return false;
+			}
+			block->capacity=TEXTBLOCK_INITIAL;
+		}
+	}
+
+	//keep twice the recent peak, shrink only from four times that
+	while(size<2*stream->peak_lines){
+		size*=2;
+	}
+	if(stream->ring_size<2*size){
+		return true;
+	}
+
+	//shrink the ring, keeping the current line first
+	for(i=0;i<stream->ring_size;i++){
+		block=stream->ring[(stream->first+i)%stream->ring_size];
+		if(i<size){
+			stream->ring[(stream->first+i)%stream->ring_size]=NULL;
+			stream->view[i]=block;
+		}
+		else{
+			free(block->text);
+			free(block);
+		}
+	}
+
+	ring=realloc(stream->ring, size*sizeof(TEXTBLOCK*));
+	if(!ring){
+		fprintf(stderr, "Failed to allocate memory\n");
+		return false;
+	}
+	memcpy(ring, stream->view, size*sizeof(TEXTBLOCK*));
+	stream->ring=ring;
+	stream->ring_size=size;
+	stream->first=0;
+
+	stream->view=realloc(stream->view, (size+1)*sizeof(TEXTBLOCK*));
+	if(!stream->view){
+		fprintf(stderr, "Failed to allocate memory\n");
+		return false;
+	}
+	return true;
+}
+
+bool string_stream_newline(STRING_STREAM* stream){
+	if(stream->lines==stream->ring_size){
+		if(stream->max_lines&&stream->ring_size==stream->max_lines+1){
+			//history full, drop the oldest line
+			string_stream_evict(stream);
+		}
+		else if(!string_stream_grow(stream)){
+			return false;
+		}
+	}
+
+	stream->lines++;
+	string_stream_clear(stream, string_stream_current(stream));
+	return true;
+}
+
+bool string_stream_append(STRING_STREAM* stream, char* data, unsigned length){
+	TEXTBLOCK* block;
+	unsigned drop;
+
+	if(!string_block_append(string_stream_current(stream), data, length)){
+		return false;
+	}
+	stream->bytes+=length;
+
+	//keep within the byte budget, dropping whole lines first
+	while(stream->max_bytes&&stream->bytes>stream->max_bytes&&stream->lines>1){
+		string_stream_evict(stream);
+	}
+
+	//a line without end is cut at its head, on a character boundary
+	if(stream->max_bytes&&stream->bytes>stream->max_bytes){
+		block=string_stream_current(stream);
+		drop=stream->bytes-stream->max_bytes;
+		while(drop<block->length&&((unsigned char)block->text[drop]&0xC0)==0x80){
+			drop++;
+		}
+		memmove(block->text, block->text+drop, block->length-drop+1);
+		block->length-=drop;
+		block->dirty=true;
+		block->damaged=true;
+		stream->bytes-=drop;
+	}
+	return true;
+}
+
+unsigned string_frame_start(char* data, unsigned length, int delimiter, unsigned long* dropped){
+	unsigned i, start=0;
+	bool data_follows=false;
+
+	//the last form feed followed by data starts the latest frame,
+	//everything before it would be cleared anyway
+	for(i=length;i>0;i--){
+		if(data[i-1]=='\f'&&data_follows){
+			start=i-1;
+			break;
+		}
+		if((unsigned char)data[i-1]!=delimiter){
+			data_follows=true;
+		}
+	}
+
+	for(i=0;i<start;i++){
+		if(data[i]=='\f'){
+			(*dropped)++;
+		}
+	}
+	return start;
+}
+
+bool string_stream_feed(STRING_STREAM* stream, char* data, unsigned length){
+	unsigned i, run=0;
+
+	if(!stream->lines){
+		if(!string_stream_newline(stream)){
+			return false;
+		}
+	}
+
+	//same semantics as string_preprocess, but only the new bytes are handled
+	for(i=0;i<length;i++){
+		if(stream->delimiter>=0&&(unsigned char)data[i]==stream->delimiter){
+			//frame commit markers are not part of the text
+			if(run&&!string_stream_append(stream, data+i-run, run)){
+				return false;
+			}
+			run=0;
+			continue;
+		}
+
+		if(stream->clear_pending){
+			//a form feed starts a new frame once new data follows
+			stream->clear_pending=false;
+			if(!string_stream_compact(stream)){
+				return false;
+			}
+		}
+
+		switch(data[i]){
+			case '\n':
+			case '\r':
+			case '\f':
+				if(run&&!string_stream_append(stream, data+i-run, run)){
+					return false;
+				}
+				run=0;
+				break;
+			default:
+				run++;
+				continue;
+		}
+
+		switch(data[i]){
+			case '\n':
+				if(!string_stream_newline(stream)){
+					return false;
+				}
+				break;
+			case '\r':
+				//clear the current line
+				string_stream_clear(stream, string_stream_current(stream));
+				break;
+			case '\f':
+				stream->clear_pending=true;
+				break;
+		}
+	}
+
+	if(run&&!string_stream_append(stream, data+length-run, run)){
+		return false;
+	}
 	return true;
 }
 
+bool string_stream_hold(STRING_STREAM* stream, char* data, unsigned length){
+	unsigned capacity=stream->held_capacity?stream->held_capacity:STDIN_DATA_CHUNK;
+
+	for(;capacity<stream->held_length+length;capacity*=2){
+	}
+
+	if(capacity!=stream->held_capacity){
+		stream->held=realloc(stream->held, capacity*sizeof(char));
+		if(!stream->held){
+			fprintf(stderr, "Failed to allocate memory\n");
+			return false;
+		}
+		stream->held_capacity=capacity;
+	}
+
+	memcpy(stream->held+stream->held_length, data, length);
+	stream->held_length+=length;
+	return true;
+}
+
+bool string_stream_input(STRING_STREAM* stream, char* data, unsigned length, bool drain, unsigned long* dropped, bool* committed){
+	unsigned start=0, end=length, held_start;
+
+	//without a frame delimiter, every read is displayed
+	if(stream->delimiter<0){
+		if(drain){
+			start=string_frame_start(data, length, stream->delimiter, dropped);
+		}
+		*committed=true;
+		return string_stream_feed(stream, data+start, length-start);
+	}
+
+	//hold everything after the last commit marker
+	for(;end>0&&(unsigned char)data[end-1]!=stream->delimiter;end--){
+	}
+	if(!end){
+		return string_stream_hold(stream, data, length);
+	}
+
+	if(drain){
+		start=string_frame_start(data, end, stream->delimiter, dropped);
+	}
+
+	//held data is only needed when no new frame starts in this read
+	if(!start&&stream->held_length){
+		held_start=drain?string_frame_start(stream->held, stream->held_length, stream->delimiter, dropped):0;
+		if(!string_stream_feed(stream, stream->held+held_start, stream->held_length-held_start)){
+			return false;
+		}
+	}
+	stream->held_length=0;
+
+	if(!string_stream_feed(stream, data+start, end-start)){
+		return false;
+	}
+	*committed=true;
+
+	return string_stream_hold(stream, data+end, length-end);
+}
+
+bool string_stream_flush(STRING_STREAM* stream){
+	unsigned length=stream->held_length;
+
+	//commit whatever is held, eg. when the input ends
+	stream->held_length=0;
+	return string_stream_feed(stream, stream->held, length);
+}
+
+TEXTBLOCK** string_stream_view(STRING_STREAM* stream){
+	unsigned i, first=0, lines=stream->lines;
+	TEXTBLOCK* current;
+
+	if(!lines){
+		return NULL;
+	}
+
+	current=string_stream_current(stream);
+	//the current line is only shown once it has content
+	if(!current->length){
+		lines--;
+	}
+	if(stream->max_lines&&lines>stream->max_lines){
+		first=lines-stream->max_lines;
+	}
+
+	for(i=first;i<lines;i++){
+		stream->view[i-first]=stream->ring[(stream->first+i)%stream->ring_size];
+		stream->view[i-first]->active=true;
+	}
+	stream->view[i-first]=NULL;
+	return stream->view;
+}
+
+void string_stream_free(STRING_STREAM* stream){
+	unsigned i;
+
+	for(i=0;i<stream->ring_size;i++){
+		free(stream->ring[i]->text);
+		free(stream->ring[i]);
+	}
+	free(stream->ring);
+	free(stream->view);
+	free(stream->held);
+	stream->ring=NULL;
+	stream->view=NULL;
+	stream->held=NULL;
+	stream->held_length=0;
+	stream->held_capacity=0;
+	stream->ring_size=0;
+	stream->lines=0;
+}
+
 unsigned string_block_longest(TEXTBLOCK** blocks){
 	unsigned i;
 	unsigned longest_length=0, longest_index=0;
@@ -156,3 +585,95 @@ bool string_blockify(TEXTBLOCK*** blocks, char* input){
 
 	return true;
 }
+
+bool string_blocks_copy(TEXTBLOCK*** dest, TEXTBLOCK** src){
+	unsigned i, num_src=0, num_dest=0, length, capacity;
+	unsigned long drawn_frame;
+	double drawn_size;
+	XRectangle drawn;
+	bool damaged;
+	char* text;
+
+	for(;src&&src[num_src];num_src++){
+	}
+
+	if(*dest){
+		for(;(*dest)[num_dest];num_dest++){
+		}
+	}
+
+	//grow destination set, keeping existing block allocations
+	if(!(*dest)||num_dest<num_src){
+		(*dest)=realloc((*dest), (num_src+1)*sizeof(TEXTBLOCK*));
+		if(!(*dest)){
+			fprintf(stderr, "Failed to allocate memory\n");
+			return false;
+		}
+
+		for(i=num_dest;i<=num_src;i++){
+			(*dest)[i]=NULL;
+		}
+
+		for(i=num_dest;i<num_src;i++){
+			(*dest)[i]=calloc(1, sizeof(TEXTBLOCK));
+			if(!(*dest)[i]){
+				fprintf(stderr, "Failed to allocate memory\n");
+				return false;
+			}
+		}
+	}
+
+	for(i=0;i<num_src;i++){
+		//the destination keeps its own drawing state
+		text=(*dest)[i]->text;
+		capacity=(*dest)[i]->capacity;
+		drawn=(*dest)[i]->drawn;
+		drawn_size=(*dest)[i]->drawn_size;
+		drawn_frame=(*dest)[i]->drawn_frame;
+		damaged=(*dest)[i]->damaged||!text||!src[i]->text||strcmp(text, src[i]->text);
+		*((*dest)[i])=*(src[i]);
+		(*dest)[i]->text=text;
+		(*dest)[i]->capacity=capacity;
+		(*dest)[i]->drawn=drawn;
+		(*dest)[i]->drawn_size=drawn_size;
+		(*dest)[i]->drawn_frame=drawn_frame;
+		(*dest)[i]->damaged=damaged;
+
+		if(src[i]->text){
+			length=strlen(src[i]->text);
+			if(!text||capacity<length+1){
+				(*dest)[i]->text=realloc(text, (length+1)*sizeof(char));
+				if(!(*dest)[i]->text){
+					fprintf(stderr, "Failed to allocate memory\n");
+					return false;
+				}
+				(*dest)[i]->capacity=length+1;
+			}
+			strcpy((*dest)[i]->text, src[i]->text);
+			(*dest)[i]->length=length;
+		}
+	}
+
+	//disable surplus blocks
+	for(;(*dest)[i];i++){
+		(*dest)[i]->active=false;
+	}
+
+	return true;
+}
+
+void string_blocks_free(TEXTBLOCK** blocks){
+	unsigned i;
+
+	if(!blocks){
+		return;
+	}
+
+	for(i=0;blocks[i];i++){
+		if(blocks[i]->text){
+			free(blocks[i]->text);
+		}
+		free(blocks[i]);
+	}
+	free(blocks);
+}
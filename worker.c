@@ -0,0 +1,172 @@
+void* worker_main(void* data){
+	LAYOUT_WORKER* worker=(LAYOUT_WORKER*)data;
+	TEXTBLOCK** swap;
+	unsigned width, height;
+	unsigned long generation;
+	bool done;
+
+	pthread_mutex_lock(&(worker->lock));
+	while(!worker->shutdown){
+		if(!worker->job_ready){
+			pthread_cond_wait(&(worker->wakeup), &(worker->lock));
+			continue;
+		}
+
+		//take the latest job
+		swap=worker->work;
+		worker->work=worker->job;
+		worker->job=swap;
+		width=worker->job_width;
+		height=worker->job_height;
+		generation=worker->generation;
+		worker->job_ready=false;
+		atomic_store(&(worker->cancel), false);
+		pthread_mutex_unlock(&(worker->lock));
+
+		errlog(&(worker->config), LOG_DEBUG, "Layout worker running generation %lu\n", generation);
+		done=x11_fit_blocks(&(worker->config), &(worker->res), worker->work, width, height);
+
+		pthread_mutex_lock(&(worker->lock));
+		if(atomic_load(&(worker->cancel))||generation!=worker->generation){
+			errlog(&(worker->config), LOG_DEBUG, "Layout worker dropped generation %lu\n", generation);
+			worker->res.stats.layouts_cancelled++;
+			continue;
+		}
+
+		if(done){
+			//publish the layout
+			swap=worker->result;
+			worker->result=worker->work;
+			worker->work=swap;
+			worker->result_generation=generation;
+		}
+		else{
+			fprintf(stderr, "Layout worker failed\n");
+			worker->failed=true;
+		}
+		worker->result_ready=true;
+
+		if(write(worker->notify[1], "", 1)<0&&errno!=EAGAIN){
+			perror("worker notify");
+		}
+	}
+	pthread_mutex_unlock(&(worker->lock));
+
+	return NULL;
+}
+
+bool worker_start(LAYOUT_WORKER* worker, CFG* config, XRESOURCES* xres){
+	int flags;
+
+	//xft is not thread safe, the worker sizes text from its own outline face
+	worker->config=*config;
+	worker->config.metrics=METRICS_OUTLINE;
+	if(!metrics_init(&(worker->res.metrics), xres->font_pattern, config)){
+		fprintf(stderr, "Layout worker needs a scalable font\n");
+		return false;
+	}
+	worker->res.cancel=&(worker->cancel);
+
+	if(pipe(worker->notify)){
+		perror("pipe");
+		metrics_free(&(worker->res.metrics));
+		return false;
+	}
+	flags=fcntl(worker->notify[0], F_GETFL, 0);
+	fcntl(worker->notify[0], F_SETFL, flags|O_NONBLOCK);
+	flags=fcntl(worker->notify[1], F_GETFL, 0);
+	fcntl(worker->notify[1], F_SETFL, flags|O_NONBLOCK);
+
+	pthread_mutex_init(&(worker->lock), NULL);
+	pthread_cond_init(&(worker->wakeup), NULL);
+
+	if(pthread_create(&(worker->thread), NULL, worker_main, worker)){
+		fprintf(stderr, "Failed to start layout worker\n");
+		pthread_cond_destroy(&(worker->wakeup));
+		pthread_mutex_destroy(&(worker->lock));
+		close(worker->notify[0]);
+		close(worker->notify[1]);
+		metrics_free(&(worker->res.metrics));
+		return false;
+	}
+
+	worker->running=true;
+	errlog(config, LOG_INFO, "Layout worker started\n");
+	return true;
+}
+
+bool worker_submit(LAYOUT_WORKER* worker, TEXTBLOCK** blocks, unsigned width, unsigned height){
+	bool rv;
+
+	pthread_mutex_lock(&(worker->lock));
+	rv=string_blocks_copy(&(worker->job), blocks);
+	worker->job_width=width;
+	worker->job_height=height;
+	worker->generation++;
+	worker->job_ready=true;
+
+	//newer input makes any running layout obsolete
+	atomic_store(&(worker->cancel), true);
+	pthread_cond_signal(&(worker->wakeup));
+	pthread_mutex_unlock(&(worker->lock));
+
+	return rv;
+}
+
+int worker_collect(LAYOUT_WORKER* worker, TEXTBLOCK** blocks, TEXTBLOCK*** layout){
+	char drain[16];
+	unsigned i;
+	int rv=0;
+
+	while(read(worker->notify[0], drain, sizeof(drain))>0){
+	}
+
+	pthread_mutex_lock(&(worker->lock));
+	if(worker->result_ready){
+		worker->result_ready=false;
+		if(worker->failed){
+			rv=-1;
+		}
+		else if(worker->result_generation==worker->generation){
+			//keep the sizes and extents as starting point for the next layout,
+			//but input committed after the submission (eg. while -maxfps holds
+			//the next layout back) may have changed or shifted the lines
+			for(i=0;blocks&&blocks[i]&&worker->result[i];i++){
+				if(strcmp(blocks[i]->text, worker->result[i]->text)){
+					continue;
+				}
+				blocks[i]->size=worker->result[i]->size;
+				blocks[i]->extents=worker->result[i]->extents;
+				blocks[i]->dirty=worker->result[i]->dirty;
+			}
+			rv=string_blocks_copy(layout, worker->result)?1:-1;
+		}
+	}
+	pthread_mutex_unlock(&(worker->lock));
+
+	return rv;
+}
+
+void worker_stop(LAYOUT_WORKER* worker){
+	if(!worker->running){
+		return;
+	}
+
+	pthread_mutex_lock(&(worker->lock));
+	worker->shutdown=true;
+	atomic_store(&(worker->cancel), true);
+	pthread_cond_signal(&(worker->wakeup));
+	pthread_mutex_unlock(&(worker->lock));
+
+	pthread_join(worker->thread, NULL);
+	pthread_cond_destroy(&(worker->wakeup));
+	pthread_mutex_destroy(&(worker->lock));
+	close(worker->notify[0]);
+	close(worker->notify[1]);
+
+	string_blocks_free(worker->job);
+	string_blocks_free(worker->work);
+	string_blocks_free(worker->result);
+	metrics_free(&(worker->res.metrics));
+	worker->running=false;
+}
@@ -1,3 +1,20 @@
+bool xfd_poll(X_FDS* set, int op, int fd){
+	struct epoll_event event;
+
+	//keep the event loop in sync with the connection set
+	if(set->epoll<0){
+		return true;
+	}
+
+	event.events=EPOLLIN;
+	event.data.fd=fd;
+	if(epoll_ctl(set->epoll, op, fd, &event)){
+		perror("xfd_poll");
+		return false;
+	}
+	return true;
+}
+
 bool xfd_add(X_FDS* set, int fd){
 	unsigned i;
 
@@ -9,7 +26,7 @@ bool xfd_add(X_FDS* set, int fd){
 		}	
 		set->size=1;
 		set->fds[0]=fd;
-		return true;
+		return xfd_poll(set, EPOLL_CTL_ADD, fd);
 	}
 
 	for(i=0;i<set->size;i++){
@@ -28,7 +45,7 @@ bool xfd_add(X_FDS* set, int fd){
 	set->fds[set->size]=fd;
 	set->size++;
 
-	return true;
+	return xfd_poll(set, EPOLL_CTL_ADD, fd);
 }
 
 bool xfd_remove(X_FDS* set, int fd){
@@ -36,6 +53,7 @@ bool xfd_remove(X_FDS* set, int fd){
 
 	for(i=0;i<set->size;i++){
 		if(set->fds[i]==fd){
+			xfd_poll(set, EPOLL_CTL_DEL, fd);
 			for(c=i;c<set->size-1;c++){
 				set->fds[c]=set->fds[c+1];
 			}
@@ -54,6 +72,18 @@ bool xfd_remove(X_FDS* set, int fd){
 	return false;
 }
 
+bool xfd_watch(X_FDS* set, int epoll){
+	unsigned i;
+
+	set->epoll=epoll;
+	for(i=0;i<set->size;i++){
+		if(!xfd_poll(set, EPOLL_CTL_ADD, set->fds[i])){
+			return false;
+		}
+	}
+	return true;
+}
+
 void xfd_free(X_FDS* set){
 	if(set->fds){
 		free(set->fds);
@@ -74,12 +104,31 @@ void xconn_watch(Display* dpy, XPointer client_data, int fd, Bool opening, XPoin
 }
 
 
+void x11_back_pixmap(XRESOURCES* res, unsigned width, unsigned height){
+	//only grows, copies are clipped to the window anyway
+	if(res->back_buffer&&width<=res->back_width&&height<=res->back_height){
+		return;
+	}
+
+	if(res->back_buffer){
+		XFreePixmap(res->display, res->back_buffer);
+	}
+
+	res->back_width=(width>res->back_width)?width:res->back_width;
+	res->back_height=(height>res->back_height)?height:res->back_height;
+	res->back_buffer=XCreatePixmap(res->display, res->main, res->back_width, res->back_height, DefaultDepth(res->display, res->screen));
+}
+
 bool x11_init(XRESOURCES* res, CFG* config){
 	Window root;
 	XSetWindowAttributes window_attributes;
+	XGCValues gc_values;
 	unsigned width, height;
-	Atom wm_state_fullscreen;
+	char* atom_names[]={"_NET_WM_STATE", "_NET_WM_STATE_FULLSCREEN"};
+	Atom atoms[2];
 	int xdbe_major, xdbe_minor;
+	FcPattern* font_request;
+	FcResult font_result;
 
 	//allocate some structures
 	XSizeHints* size_hints=XAllocSizeHints();
@@ -103,12 +152,9 @@ bool x11_init(XRESOURCES* res, CFG* config){
 	}
 
 	if(config->double_buffer){
-		config->double_buffer=(XdbeQueryExtension(res->display, &xdbe_major, &xdbe_minor)!=0);
+		res->back_pixmap=(XdbeQueryExtension(res->display, &xdbe_major, &xdbe_minor)==0);
 	}
-	else{
-		config->double_buffer=false;
-	}
-	errlog(config, LOG_INFO, "Double buffering %s\n", config->double_buffer?"enabled":"disabled");
+	errlog(config, LOG_INFO, "Double buffering %s\n", config->double_buffer?(res->back_pixmap?"via pixmap":"via XDBE"):"disabled");
 	
 	res->screen=DefaultScreen(res->display);
 	root=RootWindow(res->display, res->screen);
@@ -122,10 +168,38 @@ bool x11_init(XRESOURCES* res, CFG* config){
 		return false;
 	}
 
+	//resolve the font family once, sizes are opened from the match
+	font_request=FcPatternBuild(NULL, FC_FAMILY, FcTypeString, config->font_name, NULL);
+	if(!font_request){
+		fprintf(stderr, "Failed to build font pattern\n");
+		XFree(size_hints);
+		XFree(wm_hints);
+		XFree(class_hints);
+		return false;
+	}
+	res->font_pattern=XftFontMatch(res->display, res->screen, font_request, &font_result);
+	FcPatternDestroy(font_request);
+	if(!res->font_pattern){
+		fprintf(stderr, "Failed to match font %s\n", config->font_name);
+		XFree(size_hints);
+		XFree(wm_hints);
+		XFree(class_hints);
+		return false;
+	}
+
+	//open the face for outline measurements
+	if(config->metrics!=METRICS_XFT&&!metrics_init(&(res->metrics), res->font_pattern, config)){
+		errlog(config, LOG_INFO, "Falling back to Xft metrics\n");
+		config->metrics=METRICS_XFT;
+	}
+
 	//set up colors
 	res->text_color=colorspec_parse(config->text_color, res->display, res->screen);
 	res->bg_color=colorspec_parse(config->bg_color, res->display, res->screen);
-	res->debug_color=colorspec_parse(config->debug_color, res->display, res->screen);
+	//named colors cost a round trip each, only allocate what is drawn
+	if(config->debug_boxes){
+		res->debug_color=colorspec_parse(config->debug_color, res->display, res->screen);
+	}
 
 	//set up window params
 	window_attributes.background_pixel=res->bg_color.pixel;
@@ -157,12 +231,24 @@ bool x11_init(XRESOURCES* res, CFG* config){
 	XFree(class_hints);
 	
 	//set fullscreen mode
-	wm_state_fullscreen=XInternAtom(res->display, "_NET_WM_STATE_FULLSCREEN", False);
-	XChangeProperty(res->display, res->main, XInternAtom(res->display, "_NET_WM_STATE", False), XA_ATOM, 32, PropModeReplace, (unsigned char*) &wm_state_fullscreen, 1);
+	//intern both atoms in one round trip
+	if(!XInternAtoms(res->display, atom_names, 2, False, atoms)){
+		fprintf(stderr, "Failed to intern window state atoms\n");
+		return false;
+	}
+	XChangeProperty(res->display, res->main, atoms[0], XA_ATOM, 32, PropModeReplace, (unsigned char*) (atoms+1), 1);
 	
 	//allocate back drawing buffer
-	if(config->double_buffer){
-		res->back_buffer=XdbeAllocateBackBufferName(res->display, res->main, XdbeBackground);
+	if(config->double_buffer&&res->back_pixmap){
+		x11_back_pixmap(res, width, height);
+	}
+	else if(config->double_buffer){
+		res->back_buffer=XdbeAllocateBackBufferName(res->display, res->main, XdbeCopied);
+	}
+
+	//rasterize in the client if requested and possible
+	if(config->shm_render){
+		config->shm_render=shm_init(res, config);
 	}
 
 	//make xft drawable from window
@@ -172,6 +258,10 @@ bool x11_init(XRESOURCES* res, CFG* config){
 		fprintf(stderr, "Failed to allocate drawable\n");
 		return false;
 	}
+
+	//serves exposes from the retained back buffer, copies from pixmaps never lack source
+	gc_values.graphics_exposures=False;
+	res->copy_gc=XCreateGC(res->display, res->main, GCGraphicsExposures, &gc_values);
 	
 	//map window
 	XMapRaised(res->display, res->main);
@@ -189,6 +279,21 @@ bool x11_init(XRESOURCES* res, CFG* config){
 	return true;
 }
 
+void x11_damage_free(FRAME_DAMAGE* damage){
+	free(damage->boxes);
+	free(damage->rects);
+	free(damage->specs);
+	damage->boxes=NULL;
+	damage->rects=NULL;
+	damage->specs=NULL;
+	damage->num_specs=0;
+	damage->specs_size=0;
+	damage->num_boxes=0;
+	damage->num_rects=0;
+	damage->boxes_size=0;
+	damage->rects_size=0;
+}
+
 void x11_cleanup(XRESOURCES* xres, CFG* config){
 	if(!(xres->display)){
 		return;
@@ -196,98 +301,343 @@ void x11_cleanup(XRESOURCES* xres, CFG* config){
 
 	XftColorFree(xres->display, DefaultVisual(xres->display, xres->screen), DefaultColormap(xres->display, xres->screen), &(xres->text_color));
 	XftColorFree(xres->display, DefaultVisual(xres->display, xres->screen), DefaultColormap(xres->display, xres->screen), &(xres->bg_color));
-	XftColorFree(xres->display, DefaultVisual(xres->display, xres->screen), DefaultColormap(xres->display, xres->screen), &(xres->debug_color));
+	if(config->debug_boxes){
+		XftColorFree(xres->display, DefaultVisual(xres->display, xres->screen), DefaultColormap(xres->display, xres->screen), &(xres->debug_color));
+	}
 	if(xres->drawable){
 		XftDrawDestroy(xres->drawable);
 	}
-	if(config->double_buffer){
+	if(xres->copy_gc){
+		XFreeGC(xres->display, xres->copy_gc);
+	}
+	if(config->double_buffer&&xres->back_pixmap){
+		XFreePixmap(xres->display, xres->back_buffer);
+	}
+	else if(config->double_buffer){
 		XdbeDeallocateBackBufferName(xres->display, xres->back_buffer);
 	}
+	linecache_free(xres);
+	fontcache_free(xres);
+	shm_free(xres);
+	x11_damage_free(&(xres->damage));
+	metrics_free(&(xres->metrics));
+	if(xres->font_pattern){
+		FcPatternDestroy(xres->font_pattern);
+	}
 	XCloseDisplay(xres->display);
 	xfd_free(&(xres->xfds));
 }
 
-bool x11_draw_blocks(CFG* config, XRESOURCES* xres, TEXTBLOCK** blocks){
+void x11_block_box(TEXTBLOCK* block, XRectangle* box){
+	//pad a little, antialiasing may bleed out of the extents
+	box->x=(int)block->layout_x-DAMAGE_MARGIN;
+	box->y=(int)block->layout_y-DAMAGE_MARGIN;
+	box->width=block->extents.width+2*DAMAGE_MARGIN;
+	box->height=block->extents.height+2*DAMAGE_MARGIN;
+}
+
+bool x11_box_equal(XRectangle* a, XRectangle* b){
+	return a->x==b->x&&a->y==b->y&&a->width==b->width&&a->height==b->height;
+}
+
+bool x11_box_intersects(XRectangle* a, XRectangle* b){
+	return a->x<b->x+b->width&&b->x<a->x+a->width&&a->y<b->y+b->height&&b->y<a->y+a->height;
+}
+
+bool x11_damage_add(FRAME_DAMAGE* damage, XRectangle* rect){
+	if(damage->num_rects==damage->rects_size){
+		damage->rects_size=damage->rects_size?(2*damage->rects_size):16;
+		damage->rects=realloc(damage->rects, damage->rects_size*sizeof(XRectangle));
+		if(!damage->rects){
+			fprintf(stderr, "Failed to allocate memory\n");
+			damage->rects_size=0;
+			damage->num_rects=0;
+			return false;
+		}
+	}
+	damage->rects[damage->num_rects++]=*rect;
+	return true;
+}
+
+bool x11_damage_intersects(FRAME_DAMAGE* damage, XRectangle* rect){
 	unsigned i;
-	double current_size;
-	XftFont* font=NULL;
 
-	//early exit
-	if(!blocks||!blocks[0]){
-		return true;
+	for(i=0;i<damage->num_rects;i++){
+		if(x11_box_intersects(damage->rects+i, rect)){
+			return true;
+		}
+	}
+	return false;
+}
+
+bool x11_damage_collect(FRAME_DAMAGE* damage, TEXTBLOCK** blocks, unsigned num_blocks){
+	unsigned i, p;
+	XRectangle box;
+
+	//blocks that changed or were not drawn in the last frame are redrawn,
+	//as are last frame's boxes no clean block occupies anymore
+	for(i=0;i<num_blocks;i++){
+		x11_block_box(blocks[i], &box);
+		if(blocks[i]->drawn_frame!=damage->frame-1
+				|| blocks[i]->drawn_size!=blocks[i]->size
+				|| !x11_box_equal(&(blocks[i]->drawn), &box)){
+			blocks[i]->damaged=true;
+		}
+		if(blocks[i]->damaged&&!x11_damage_add(damage, &box)){
+			return false;
+		}
+	}
+
+	//both the old boxes and the blocks are ordered top to bottom
+	for(i=0, p=0;p<damage->num_boxes;p++){
+		for(;i<num_blocks&&(int)blocks[i]->layout_y-DAMAGE_MARGIN<damage->boxes[p].y;i++){
+		}
+		if(i<num_blocks){
+			//either still valid or already part of the damage
+			x11_block_box(blocks[i], &box);
+			if(x11_box_equal(&box, damage->boxes+p)){
+				continue;
+			}
+		}
+		if(!x11_damage_add(damage, damage->boxes+p)){
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void x11_glyphs_flush(XRESOURCES* xres){
+	FRAME_DAMAGE* damage=&(xres->damage);
+
+	if(damage->num_specs){
+		XftDrawGlyphFontSpec(xres->drawable, &(xres->text_color), damage->specs, damage->num_specs);
+		damage->num_specs=0;
+	}
+
+	//the fonts are no longer referenced
+	xres->fonts.pinned_from=xres->fonts.use_counter+1;
+}
+
+bool x11_glyphs_append(XRESOURCES* xres, CFG* config, TEXTBLOCK* block){
+	unsigned offset=0, length=strlen(block->text);
+	int consumed, x=block->layout_x+block->extents.x, y=block->layout_y+block->extents.y;
+	FcChar32 codepoint;
+	FONTCACHE_ENTRY* font;
+	GLYPH_METRICS* glyph;
+	FRAME_DAMAGE* damage=&(xres->damage);
+	XftGlyphFontSpec* specs;
+
+	font=fontcache_entry(xres, config, block->size);
+	if(!font){
+		//every cached font is part of the batch, send it to free a slot
+		x11_glyphs_flush(xres);
+		font=fontcache_entry(xres, config, block->size);
+		if(!font){
+			fprintf(stderr, "Failed to load block font (%s, %d)\n", config->font_name, (int)block->size);
+			return false;
+		}
+	}
+
+	//at most one glyph per byte
+	if(damage->num_specs+length>damage->specs_size){
+		specs=realloc(damage->specs, (damage->num_specs+length)*2*sizeof(XftGlyphFontSpec));
+		if(!specs){
+			fprintf(stderr, "Failed to allocate memory\n");
+			return false;
+		}
+		damage->specs=specs;
+		damage->specs_size=(damage->num_specs+length)*2;
+	}
+
+	//position the glyphs along the pen, like xft does
+	while(offset<length){
+		if((unsigned char)block->text[offset]<0x80){
+			codepoint=block->text[offset];
+			consumed=1;
+		}
+		else{
+			consumed=FcUtf8ToUcs4((FcChar8*)block->text+offset, &codepoint, length-offset);
+			if(consumed<=0){
+				break;
+			}
+		}
+		offset+=consumed;
+
+		glyph=glyphs_get(&(font->glyphs), codepoint);
+		if(!glyph){
+			return false;
+		}
+
+		damage->specs[damage->num_specs].font=font->font;
+		damage->specs[damage->num_specs].glyph=glyph->index;
+		damage->specs[damage->num_specs].x=x;
+		damage->specs[damage->num_specs].y=y;
+		damage->num_specs++;
+		x+=glyph->advance;
 	}
 
+	return true;
+}
+
+bool x11_damage_store(FRAME_DAMAGE* damage, TEXTBLOCK** blocks, unsigned num_blocks){
+	unsigned i;
+
+	//remember this frame for the next one
+	if(num_blocks>damage->boxes_size){
+		damage->boxes=realloc(damage->boxes, num_blocks*sizeof(XRectangle));
+		if(!damage->boxes){
+			fprintf(stderr, "Failed to allocate memory\n");
+			damage->boxes_size=0;
+			damage->num_boxes=0;
+			damage->full=true;
+			return false;
+		}
+		damage->boxes_size=num_blocks;
+	}
+	for(i=0;i<num_blocks;i++){
+		x11_block_box(blocks[i], &(blocks[i]->drawn));
+		blocks[i]->drawn_size=blocks[i]->size;
+		blocks[i]->drawn_frame=damage->frame;
+		blocks[i]->damaged=false;
+		damage->boxes[i]=blocks[i]->drawn;
+	}
+	damage->num_boxes=num_blocks;
+	damage->full=false;
+
+	return true;
+}
+
+bool x11_draw_blocks(CFG* config, XRESOURCES* xres, TEXTBLOCK** blocks){
+	unsigned i, num_blocks=0;
+	FRAME_DAMAGE* damage=&(xres->damage);
+	XRectangle box;
+	bool ok;
+	LINECACHE_ENTRY* line;
+
+	damage->frame++;
+	damage->num_rects=0;
+
+	for(;blocks&&blocks[num_blocks]&&blocks[num_blocks]->active;num_blocks++){
+	}
+
+	//restrict drawing to what changed since the last frame
+	if(damage->full){
+		XftDrawSetClip(xres->drawable, NULL);
+		for(i=0;i<num_blocks;i++){
+			blocks[i]->damaged=true;
+		}
+	}
+	else{
+		if(!x11_damage_collect(damage, blocks, num_blocks)){
+			return false;
+		}
+		errlog(config, LOG_DEBUG, "Frame %lu has %d damaged areas\n", damage->frame, damage->num_rects);
+		if(!damage->num_rects){
+			//nothing to draw, but the blocks are still current for the next frame
+			return x11_damage_store(damage, blocks, num_blocks);
+		}
+		XftDrawSetClipRectangles(xres->drawable, 0, 0, damage->rects, damage->num_rects);
+		XSetClipRectangles(xres->display, xres->copy_gc, 0, 0, damage->rects, damage->num_rects, Unsorted);
+	}
+
+	//clean blocks overlapping the damage are drawn again, clipped
+	for(i=0;i<num_blocks;i++){
+		if(!blocks[i]->damaged){
+			x11_block_box(blocks[i], &box);
+			blocks[i]->damaged=x11_damage_intersects(damage, &box);
+		}
+	}
+
+	if(config->shm_render&&xres->shm.image){
+		ok=shm_draw_frame(xres, config, blocks, num_blocks, damage->full);
+		XftDrawSetClip(xres->drawable, NULL);
+		XSetClipMask(xres->display, xres->copy_gc, None);
+		return ok&&x11_damage_store(damage, blocks, num_blocks);
+	}
+
+	//the back buffer is retained, so clear only the damaged areas
+	XftDrawRect(xres->drawable, &(xres->bg_color), 0, 0, 0xFFFF, 0xFFFF);
+
 	//draw debug blocks if requested
 	if(config->debug_boxes){
-		for(i=0;blocks[i]&&blocks[i]->active;i++){
-			 XftDrawRect(xres->drawable, &(xres->debug_color), blocks[i]->layout_x, blocks[i]->layout_y, blocks[i]->extents.width, blocks[i]->extents.height);
+		for(i=0;i<num_blocks;i++){
+			if(blocks[i]->damaged){
+				XftDrawRect(xres->drawable, &(xres->debug_color), blocks[i]->layout_x, blocks[i]->layout_y, blocks[i]->extents.width, blocks[i]->extents.height);
+			}
 		}
 	}
 
-	//draw boxes only
-	if(config->disable_text){
-		return true;
-	}
+	//draw all damaged blocks, fonts in the glyph batch must stay open
+	xres->fonts.pinned_from=xres->fonts.use_counter+1;
+	for(i=0;i<num_blocks&&!config->disable_text;i++){
+		if(!blocks[i]->damaged||!blocks[i]->text[0]){
+			continue;
+		}
 
-	//draw all blocks
-	for(i=0;blocks[i]&&blocks[i]->active;i++){
-		//load font
-		if(!font||(font&&current_size!=blocks[i]->size)){
-			if(font){
-				XftFontClose(xres->display, font);
-			}
-			font=XftFontOpen(xres->display, xres->screen,
-					XFT_FAMILY, XftTypeString, config->font_name,
-					XFT_PIXEL_SIZE, XftTypeDouble, blocks[i]->size,
-					NULL
-			);
-			current_size=blocks[i]->size;
-			if(!font){
-				fprintf(stderr, "Failed to load block font (%s, %d)\n", config->font_name, (int)current_size);
-				return false;
+		//copy cached lines, the pixmap is opaque so debug boxes bypass it
+		if(config->line_cache&&!config->debug_boxes){
+			line=linecache_get(xres, config, blocks[i]);
+			if(line){
+				XCopyArea(xres->display, line->pixmap, config->double_buffer?xres->back_buffer:xres->main, xres->copy_gc,
+						0, 0, line->width, line->height,
+						blocks[i]->layout_x, blocks[i]->layout_y);
+				continue;
 			}
 		}
 
-		//draw text
 		errlog(config, LOG_DEBUG, "Drawing block %d (%s) at layoutcoords %d|%d size %d\n", i, blocks[i]->text, 
 				blocks[i]->layout_x+blocks[i]->extents.x, 
 				blocks[i]->layout_y+blocks[i]->extents.y, 
 				(int)blocks[i]->size);
 
-		XftDrawStringUtf8(xres->drawable, 
-				&(xres->text_color), 
-				font, 
-				blocks[i]->layout_x+blocks[i]->extents.x, 
-				blocks[i]->layout_y+blocks[i]->extents.y, 
-				(FcChar8*)blocks[i]->text, 
-				strlen(blocks[i]->text));
+		if(!x11_glyphs_append(xres, config, blocks[i])){
+			damage->num_specs=0;
+			xres->fonts.pinned_from=0;
+			return false;
+		}
 	}
 
-	//clean up the mess
-	if(font){
-		XftFontClose(xres->display, font);
-	}
+	//everything not copied goes out in one request
+	x11_glyphs_flush(xres);
+	xres->fonts.pinned_from=0;
 
-	return true;
+	XftDrawSetClip(xres->drawable, NULL);
+	XSetClipMask(xres->display, xres->copy_gc, None);
+
+	return x11_damage_store(damage, blocks, num_blocks);
 }
 
+
 bool x11_blocks_resize(XRESOURCES* xres, CFG* config, TEXTBLOCK** blocks, XGlyphInfo* bounding_box, double size){
-	XftFont* font=NULL;
+	FONTCACHE_ENTRY* font=NULL;
+	XGlyphInfo reference;
 	unsigned bounding_width=0, bounding_height=0;
-	unsigned i;
-
-	//FIXME is config needed here?
-
-	//load font with at supplied size
-	font=XftFontOpen(xres->display, xres->screen,
-			XFT_FAMILY, XftTypeString, config->font_name,
-			XFT_PIXEL_SIZE, XftTypeDouble, size,
-			NULL
-	);
-	
-	if(!font){
-		fprintf(stderr, "Could not load font\n");
-		return false;
+	unsigned i, pending=0;
+	bool measured=false;
+
+	//load font with at supplied size, outline metrics do not need one
+	if(config->metrics!=METRICS_OUTLINE){
+		font=fontcache_entry(xres, config, size);
+		if(!font){
+			fprintf(stderr, "Could not load font\n");
+			return false;
+		}
+	}
+	else if(xres->pool){
+		//spread larger batches over the measurement threads
+		for(i=0;blocks[i]&&blocks[i]->active;i++){
+			if(!(blocks[i]->calculated)&&(blocks[i]->dirty||blocks[i]->size!=size)){
+				pending++;
+			}
+		}
+		if(pending>=MEASURE_PARALLEL_MIN){
+			if(!pool_measure(xres->pool, &(xres->metrics), blocks, size)){
+				fprintf(stderr, "Failed to measure blocks in parallel\n");
+				return false;
+			}
+			measured=true;
+		}
 	}
 	
 	//fprintf(stderr, "Block \"%s\" extents: width %d, height %d, x %d, y %d, xOff %d, yOff %d\n",
@@ -298,9 +648,34 @@ bool x11_blocks_resize(XRESOURCES* xres, CFG* config, TEXTBLOCK** blocks, XGlyph
 	for(i=0;blocks[i]&&blocks[i]->active;i++){
 		//update only not yet calculated blocks
 		if(!(blocks[i]->calculated)){
-			XftTextExtentsUtf8(xres->display, font, (FcChar8*)blocks[i]->text, strlen(blocks[i]->text), &(blocks[i]->extents));
+			if(!blocks[i]->dirty&&blocks[i]->size==size){
+				//unchanged since last measured at this size
+			}
+			else if(measured){
+				//extents already filled in by the pool
+			}
+			else if(config->metrics==METRICS_XFT){
+				if(!glyphs_text_extents(&(font->glyphs), 1, blocks[i]->text, &(blocks[i]->extents))){
+					fprintf(stderr, "Failed to measure block %d\n", i);
+					return false;
+				}
+			}
+			else{
+				if(!metrics_text_extents(&(xres->metrics), size, blocks[i]->text, &(blocks[i]->extents))){
+					fprintf(stderr, "Failed to measure block %d\n", i);
+					return false;
+				}
+
+				if(config->metrics==METRICS_COMPARE){
+					XftTextExtentsUtf8(xres->display, font->font, (FcChar8*)blocks[i]->text, strlen(blocks[i]->text), &reference);
+					errlog(config, LOG_INFO, "Block %d at size %d: outline %dx%d (%d|%d), xft %dx%d (%d|%d)\n", i, (int)size,
+							blocks[i]->extents.width, blocks[i]->extents.height, blocks[i]->extents.x, blocks[i]->extents.y,
+							reference.width, reference.height, reference.x, reference.y);
+				}
+			}
 			errlog(config, LOG_DEBUG, "Recalculated block %d (%s) extents: %dx%d\n", i, blocks[i]->text, blocks[i]->extents.width, blocks[i]->extents.height);
 			blocks[i]->size=size;
+			blocks[i]->dirty=false;
 		}
 		
 		//calculate bounding box over all
@@ -315,19 +690,224 @@ bool x11_blocks_resize(XRESOURCES* xres, CFG* config, TEXTBLOCK** blocks, XGlyph
 		bounding_box->height=bounding_height;
 	}
 
-	XftFontClose(xres->display, font);
+	return true;
+}
+
+void x11_layout_volume(CFG* config, unsigned num_blocks, unsigned width, unsigned height, unsigned* layout_width, unsigned* layout_height){
+	*layout_width=width;
+	*layout_height=height;
+
+	if(width>(2*config->padding)){
+		*layout_width-=2*config->padding;
+	}
+	if(height>(2*config->padding)){
+		errlog(config, LOG_DEBUG, "Subtracting %d pixels for height padding\n", config->padding);
+		*layout_height-=2*config->padding;
+	}
+	if(num_blocks>1&&(((num_blocks-1)*(config->line_spacing)<*layout_height))){
+		errlog(config, LOG_DEBUG, "Subtracting %d pixels for linespacing\n", (num_blocks-1)*config->line_spacing);
+		*layout_height-=(num_blocks-1)*config->line_spacing;
+	}
+}
+
+bool x11_block_finalize(XRESOURCES* xres, CFG* config, TEXTBLOCK* block){
+	FONTCACHE_ENTRY* font=fontcache_entry(xres, config, block->size);
+
+	if(!font){
+		fprintf(stderr, "Failed to load block font (%s, %d)\n", config->font_name, (int)block->size);
+		return false;
+	}
+
+	if(!glyphs_text_extents(&(font->glyphs), 1, block->text, &(block->extents))){
+		fprintf(stderr, "Failed to measure block (%s)\n", block->text);
+		return false;
+	}
+	return true;
+}
+
+bool x11_blocks_finalize(XRESOURCES* xres, CFG* config, TEXTBLOCK** blocks, unsigned width, unsigned height, METRICS_BACKEND measured){
+	unsigned i, num_blocks, layout_width, layout_height, bounding_width, bounding_height;
+	double largest;
+	bool shrunk=true;
+
+	//sizes found via outline metrics are measured once more via xft,
+	//so only the winning sizes are rasterized and drawing matches the extents
+	if(measured==METRICS_XFT){
+		return true;
+	}
+
+	for(i=0;blocks[i]&&blocks[i]->active;i++){
+		if(!blocks[i]->text[0]){
+			continue;
+		}
+
+		if(!x11_block_finalize(xres, config, blocks[i])){
+			return false;
+		}
+		errlog(config, LOG_DEBUG, "Finalized block %d extents: %dx%d\n", i, blocks[i]->extents.width, blocks[i]->extents.height);
+	}
+	num_blocks=i;
+
+	if(config->force_size!=0){
+		return true;
+	}
+
+	//hinted advances may exceed the outline extents the sizes were chosen by
+	x11_layout_volume(config, num_blocks, width, height, &layout_width, &layout_height);
+	while(shrunk){
+		bounding_width=0;
+		bounding_height=0;
+		largest=0;
+		for(i=0;i<num_blocks;i++){
+			bounding_height+=blocks[i]->extents.height;
+			bounding_width=(blocks[i]->extents.width>bounding_width)?blocks[i]->extents.width:bounding_width;
+			largest=(blocks[i]->text[0]&&blocks[i]->size>largest)?blocks[i]->size:largest;
+		}
+
+		if(bounding_width<=layout_width&&bounding_height<=layout_height){
+			break;
+		}
+
+		//step down what overflows, lines sized together stay together
+		shrunk=false;
+		for(i=0;i<num_blocks;i++){
+			if(!blocks[i]->text[0]||blocks[i]->size<=1){
+				continue;
+			}
+			if(!config->independent_resize
+					|| blocks[i]->extents.width>layout_width
+					|| (bounding_width<=layout_width&&blocks[i]->size==largest)){
+				blocks[i]->size-=1;
+				if(!x11_block_finalize(xres, config, blocks[i])){
+					return false;
+				}
+				errlog(config, LOG_DEBUG, "Stepped block %d down to size %d after finalizing\n", i, (int)blocks[i]->size);
+				shrunk=true;
+			}
+		}
+	}
+
+	return true;
+}
+
+bool x11_probe_size(XRESOURCES* xres, CFG* config, TEXTBLOCK** blocks, unsigned width, unsigned height, unsigned size, XGlyphInfo* bbox){
+	if(xres->cancel&&atomic_load(xres->cancel)){
+		errlog(config, LOG_DEBUG, "Layout cancelled\n");
+		return false;
+	}
+
+	xres->stats.layout_probes++;
+	if(!x11_blocks_resize(xres, config, blocks, bbox, size)){
+		fprintf(stderr, "Failed to resize blocks to test size %d\n", size);
+		return false;
+	}
+	errlog(config, LOG_DEBUG, "Size %d gives bounding box %dx%d -> %s\n", size, bbox->width, bbox->height, (bbox->width>width||bbox->height>height)?"OOB":"OK");
+	return true;
+}
+
+bool x11_search_size(XRESOURCES* xres, CFG* config, TEXTBLOCK** blocks, unsigned width, unsigned height, unsigned reference, XGlyphInfo* bbox, unsigned* size){
+	unsigned i, current_size=reference, step;
+	unsigned bound_low=0, bound_high=0;
+	double scale;
+
+	//expects the blocks to be measured at the reference size
+	//extents scale almost linearly with the size, so predict the fitting size
+	//and refine the prediction from the last measurement
+	for(i=0;i<PREDICTOR_ROUNDS;i++){
+		scale=fmin((double)width/(double)bbox->width, (double)height/(double)bbox->height);
+		current_size=floor(reference*scale);
+		if(current_size<1){
+			current_size=1;
+		}
+		if(config->max_size>0&&current_size>config->max_size){
+			errlog(config, LOG_DEBUG, "Enforcing size constraint\n");
+			current_size=config->max_size;
+		}
+		errlog(config, LOG_DEBUG, "Predicted size %d from reference %d\n", current_size, reference);
+
+		if(current_size==reference){
+			break;
+		}
+
+		if(!x11_probe_size(xres, config, blocks, width, height, current_size, bbox)){
+			return false;
+		}
+		reference=current_size;
+
+		if(bbox->width<1||bbox->height<1){
+			break;
+		}
+	}
+
+	if(bbox->width>width||bbox->height>height){
+		bound_high=current_size;
+	}
+	else{
+		bound_low=current_size;
+	}
+
+	//step away from the prediction by 1, 2, 4... pixels to correct for hinting until bracketed
+	for(step=1;!bound_low||!bound_high;step*=2){
+		if(!bound_high){
+			if(config->max_size>0&&bound_low>=config->max_size){
+				bound_high=bound_low+1;
+				break;
+			}
+			current_size=bound_low+step;
+			if(config->max_size>0&&current_size>config->max_size){
+				current_size=config->max_size;
+			}
+		}
+		else{
+			if(bound_high<=1){
+				errlog(config, LOG_DEBUG, "Search went out of permissible range\n");
+				bound_low=1;
+				break;
+			}
+			current_size=(bound_high>step+1)?(bound_high-step):1;
+		}
+
+		if(!x11_probe_size(xres, config, blocks, width, height, current_size, bbox)){
+			return false;
+		}
+		if(bbox->width>width||bbox->height>height){
+			bound_high=current_size;
+		}
+		else{
+			bound_low=current_size;
+		}
+	}
+
+	//binary search within the remaining bracket
+	while(bound_high-bound_low>1){
+		current_size=bound_low+(bound_high-bound_low)/2;
+		if(!x11_probe_size(xres, config, blocks, width, height, current_size, bbox)){
+			return false;
+		}
+		if(bbox->width>width||bbox->height>height){
+			bound_high=current_size;
+		}
+		else{
+			bound_low=current_size;
+		}
+	}
+
+	//leave the blocks measured at the final size
+	if(current_size!=bound_low&&!x11_probe_size(xres, config, blocks, width, height, bound_low, bbox)){
+		return false;
+	}
+
+	*size=bound_low;
 	return true;
 }
 
 bool x11_maximize_blocks(XRESOURCES* xres, CFG* config, TEXTBLOCK** blocks, unsigned width, unsigned height){
 	unsigned i, num_blocks=0;
-	double current_size=1;
-	unsigned bound_low, bound_high, bound_delta;
+	unsigned reference, final_size;
+	unsigned long probes=xres->stats.layout_probes;
 	unsigned done_block, longest_block;
 	XGlyphInfo bbox;
-	bool break_loop=false;
-
-	int bounds_delta=4; //initial secondary bound delta
+	bool warm=false;
 
 	//count blocks
 	for(i=0;blocks[i]&&blocks[i]->active;i++){
@@ -343,132 +923,269 @@ bool x11_maximize_blocks(XRESOURCES* xres, CFG* config, TEXTBLOCK** blocks, unsi
 	}
 
 	errlog(config, LOG_DEBUG, "Maximizer running for %dx%d bounds\n", width, height);
+	xres->stats.layout_passes++;
 
-	//guess primary bound
+	//choose reference size
 	//sizes in sets to be maximized are always the same,
 	//since any pass modifies all active blocks to the same size
 	longest_block=string_block_longest(blocks);
-	if(blocks[longest_block]->size==0){
-		if(config->max_size>0){
-			//use max size as primary bound
-			current_size=config->max_size;
-		}
-		else{
-			//educated guess
-			current_size=fabs(width/((strlen(blocks[longest_block]->text)>0)?strlen(blocks[longest_block]->text):1));
-		}
+	if(blocks[longest_block]->size>=1){
+		//use last known size
+		reference=blocks[longest_block]->size;
+		warm=true;
+	}
+	else if(config->max_size>0){
+		reference=config->max_size;
 	}
 	else{
-		//use last known size as primary bound
-		current_size=blocks[longest_block]->size;
+		reference=PREDICTOR_REFERENCE_SIZE;
 	}
-	errlog(config, LOG_DEBUG, "Guessing primary bound %d\n", (int)current_size);
 
-	//find secondary bound for binary search
-	if(!x11_blocks_resize(xres, config, blocks, &bbox, current_size)){
-		fprintf(stderr, "Failed to resize blocks to primary bound\n");
+	if(!x11_probe_size(xres, config, blocks, width, height, reference, &bbox)){
+		return false;
 	}
 
-	if(bbox.height>height||bbox.width>width){
-		//primary bound is upper bound, search down
-		bounds_delta*=-1;
+	if(bbox.width<1||bbox.height<1){
+		errlog(config, LOG_DEBUG, "Bounding box was empty\n");
+		return true;
 	}
-	errlog(config, LOG_DEBUG, "Primary bound is %s than bounding box\n", (bounds_delta<0)?"bigger":"smaller");
 
-	do{
-		bounds_delta*=2;
+	if(warm&&config->size_hysteresis>0
+			&&bbox.width<=width&&bbox.height<=height
+			&&floor(reference*fmin((double)width/(double)bbox.width, (double)height/(double)bbox.height))<=reference+config->size_hysteresis){
+		//hold the last size while it fits and the predicted gain is small
+		errlog(config, LOG_DEBUG, "Holding size %d\n", reference);
+		final_size=reference;
+	}
+	else if(!x11_search_size(xres, config, blocks, width, height, reference, &bbox, &final_size)){
+		return false;
+	}
+	errlog(config, LOG_INFO, "Final size is %d after %lu probes\n", final_size, xres->stats.layout_probes-probes);
 
-		if(current_size+bounds_delta<1){
-			errlog(config, LOG_DEBUG, "Search went out of permissible range\n");
-			bounds_delta=-current_size; //FIXME this might fail when the condition is met with an overflow
-			break;
+	//set active to false for the widest block as measured at the final size
+	for(i=1,done_block=0;blocks[i]&&blocks[i]->active;i++){
+		if(!blocks[i]->calculated&&(blocks[done_block]->calculated||blocks[i]->extents.width>blocks[done_block]->extents.width)){
+			done_block=i;
 		}
+	}
+	blocks[done_block]->calculated=true;
+	errlog(config, LOG_DEBUG, "Marked block %d as done\n", done_block);
 
-		if(!x11_blocks_resize(xres, config, blocks, &bbox, current_size+bounds_delta)){
-			fprintf(stderr, "Failed to resize blocks to size %d\n", (int)current_size+bounds_delta);
-			return false;
-		}
+	return true;
+}
 
-		if(bbox.width<1||bbox.height<1){
-			errlog(config, LOG_DEBUG, "Bounding box was empty\n");
-			return true;
-		}
+bool x11_measure_lines(XRESOURCES* xres, CFG* config, LINE_FIT* fits, TEXTBLOCK** set, unsigned num_lines, unsigned size, unsigned* height){
+	unsigned i;
+	XGlyphInfo bbox;
 
-		errlog(config, LOG_DEBUG, "With bounds_delta %d bounding box is %dx%d\n", bounds_delta, bbox.width, bbox.height);
+	//measure the first num_lines lines at a common size
+	for(i=0;i<num_lines;i++){
+		set[i]=fits[i].block;
+		fits[i].block->calculated=false;
 	}
-	//loop until direction needs to be reversed
-	while(	((bounds_delta<0)&&(bbox.width>width||bbox.height>height)) //searching lower bound, break if within bounds
-		|| ((bounds_delta>0)&&(bbox.width<=width&&bbox.height<=height))); //searching upper bound, break if out of bounds
-	errlog(config, LOG_DEBUG, "Calculated secondary bound %d via offset %d\n", (int)current_size+bounds_delta, bounds_delta);
+	set[num_lines]=NULL;
 
-	//prepare bounds for binary search
-	if(bounds_delta<0){
-		bound_low=current_size+bounds_delta;
-		bound_high=current_size; //cant optimize here if starting bound matches exactly
-	}
-	else{
-		bound_high=current_size+bounds_delta;
-		bound_low=current_size; //cant optimize here if starting bound matches exactly
+	if(xres->cancel&&atomic_load(xres->cancel)){
+		errlog(config, LOG_DEBUG, "Layout cancelled\n");
+		return false;
 	}
 
-	if(config->max_size>0&&bound_high>config->max_size){
-		errlog(config, LOG_DEBUG, "Enforcing size constraint\n");
-		bound_high=config->max_size;
+	xres->stats.layout_probes++;
+	if(!x11_blocks_resize(xres, config, set, &bbox, size)){
+		fprintf(stderr, "Failed to resize lines to size %d\n", size);
+		return false;
 	}
-	if(config->max_size>0&&bound_low>config->max_size){
-		bound_low=1;
+
+	*height=bbox.height;
+	return true;
+}
+
+bool x11_fit_lines(XRESOURCES* xres, CFG* config, TEXTBLOCK** blocks, LINE_FIT* fits, TEXTBLOCK** set, unsigned num_lines, unsigned width, unsigned height){
+	unsigned i, remaining, widest, lines_height, fixed_height=0, grown_height=0;
+	unsigned size=0, bound_low, bound_high, current;
+	TEXTBLOCK* single[2]={NULL, NULL};
+	LINE_FIT swap;
+	bool grown=false;
+
+	//fit every line on its own, limited by the width
+	for(i=0,current=0;blocks[i]&&blocks[i]->active;i++){
+		if(blocks[i]->calculated){
+			//lines done before still take up their height
+			fixed_height+=blocks[i]->extents.height;
+			continue;
+		}
+
+		single[0]=blocks[i];
+		if(!x11_maximize_blocks(xres, config, single, width, height)){
+			return false;
+		}
+		fits[current].block=blocks[i];
+		fits[current].index=i;
+		fits[current].size=blocks[i]->size;
+		current++;
 	}
 
-	//binary search for final size
-	do{
-		bound_delta=bound_high-bound_low;
-		current_size=bound_low+((double)bound_delta/(double)2);
-		
-		//stupid tiebreaker implementation
-		if(bound_delta/2==0){
-			if(break_loop){
-				current_size=bound_high;
+	//same result as maximizing all open lines to one size and fixing
+	//the widest of them, once per line. the common size never shrinks
+	//between passes and the width limits are known, so a pass only has
+	//to find how far the height left over by the fixed lines lets it grow.
+	for(remaining=num_lines;remaining>0;remaining--){
+		//open lines are kept in fits[0..remaining-1]
+		bound_high=fits[0].size;
+		for(i=1;i<remaining;i++){
+			if(fits[i].size<bound_high){
+				bound_high=fits[i].size;
+			}
+		}
+
+		//the last common size fit with these lines open
+		bound_low=size;
+		if(grown&&size<bound_high){
+			//total height one size up is known from the last pass
+			if(grown_height<=height){
+				bound_low=size+1;
 			}
 			else{
-				break_loop=true;
+				bound_high=size;
 			}
 		}
 
-		errlog(config, LOG_DEBUG, "Binary search testing size %d, hi %d, lo %d, delta %d\n", (int)current_size, bound_high, bound_low, bound_delta);
+		if(bound_high>bound_low){
+			if(!x11_measure_lines(xres, config, fits, set, remaining, bound_high, &lines_height)){
+				return false;
+			}
 
-		if(!x11_blocks_resize(xres, config, blocks, &bbox, current_size)){
-			fprintf(stderr, "Failed to resize blocks to test size %d\n", (int)current_size);
-			return false;
+			if(fixed_height+lines_height<=height){
+				bound_low=bound_high;
+			}
 		}
 
-		if(bbox.width<1||bbox.height<1){
-			errlog(config, LOG_DEBUG, "Bounding box is 0, bailing out\n");
-			break;
+		//limited by height, most passes keep the size
+		if(bound_high-bound_low>1&&bound_low==size&&size>0){
+			if(!x11_measure_lines(xres, config, fits, set, remaining, size+1, &lines_height)){
+				return false;
+			}
+
+			grown=true;
+			grown_height=fixed_height+lines_height;
+			if(grown_height<=height){
+				bound_low=size+1;
+			}
+			else{
+				bound_high=size+1;
+			}
 		}
 
-		if(bbox.width>width||bbox.height>height){
-			//out of bounds
-			bound_high=current_size;
-			errlog(config, LOG_DEBUG, "-> OOB\n");
+		while(bound_high-bound_low>1){
+			current=bound_low+(bound_high-bound_low)/2;
+			if(!x11_measure_lines(xres, config, fits, set, remaining, current, &lines_height)){
+				return false;
+			}
+
+			if(fixed_height+lines_height<=height){
+				bound_low=current;
+			}
+			else{
+				bound_high=current;
+			}
 		}
-		else{
-			//inside bounds
-			bound_low=current_size;
-			errlog(config, LOG_DEBUG, "-> OK\n");
+
+		if(bound_low<1){
+			errlog(config, LOG_DEBUG, "Search went out of permissible range\n");
+			bound_low=1;
 		}
 
-	}while(bound_delta>0);
-	errlog(config, LOG_DEBUG, "Final size is %d\n", (int)current_size);
+		if(bound_low!=size){
+			grown=false;
+		}
+		size=bound_low;
 
-	//set active to false for longest
-	//FIXME find longest by actual extents
-	done_block=string_block_longest(blocks);
-	blocks[done_block]->calculated=true;
-	errlog(config, LOG_DEBUG, "Marked block %d as done\n", done_block);
+		//leave the open lines measured at the common size
+		if(!x11_measure_lines(xres, config, fits, set, remaining, size, &lines_height)){
+			return false;
+		}
+
+		//fix the widest open line, the first one on ties
+		for(i=1,widest=0;i<remaining;i++){
+			if(fits[i].block->extents.width>fits[widest].block->extents.width
+					|| (fits[i].block->extents.width==fits[widest].block->extents.width&&fits[i].index<fits[widest].index)){
+				widest=i;
+			}
+		}
+		errlog(config, LOG_DEBUG, "Fixed line %d at size %d\n", fits[widest].index, size);
+
+		//the fixed line no longer grows with the others
+		single[0]=fits[widest].block;
+		if(grown){
+			if(!x11_blocks_resize(xres, config, single, NULL, size+1)){
+				fprintf(stderr, "Failed to resize line to size %d\n", size+1);
+				return false;
+			}
+			grown_height-=single[0]->extents.height;
+
+			if(!x11_blocks_resize(xres, config, single, NULL, size)){
+				fprintf(stderr, "Failed to resize line to size %d\n", size);
+				return false;
+			}
+			grown_height+=single[0]->extents.height;
+		}
+
+		fits[widest].size=size;
+		fixed_height+=single[0]->extents.height;
+		swap=fits[widest];
+		fits[widest]=fits[remaining-1];
+		fits[remaining-1]=swap;
+	}
+
+	//leave every line measured at its final size
+	for(i=0;i<num_lines;i++){
+		single[0]=fits[i].block;
+		single[0]->calculated=false;
+		if(!x11_blocks_resize(xres, config, single, NULL, fits[i].size)){
+			fprintf(stderr, "Failed to resize line to size %d\n", fits[i].size);
+			return false;
+		}
+		single[0]->calculated=true;
+	}
 
 	return true;
 }
 
+bool x11_maximize_independent(XRESOURCES* xres, CFG* config, TEXTBLOCK** blocks, unsigned width, unsigned height){
+	unsigned i, num_lines=0;
+	unsigned long probes=xres->stats.layout_probes;
+	LINE_FIT* fits;
+	TEXTBLOCK** set;
+	bool rv;
+
+	for(i=0;blocks[i]&&blocks[i]->active;i++){
+		if(!blocks[i]->calculated){
+			num_lines++;
+		}
+	}
+
+	if(num_lines<1||width<1||height<1){
+		errlog(config, LOG_DEBUG, "Independent maximizer bailing out, nothing to do\n");
+		return true;
+	}
+
+	fits=calloc(num_lines, sizeof(LINE_FIT));
+	set=calloc(num_lines+1, sizeof(TEXTBLOCK*));
+	if(!fits||!set){
+		fprintf(stderr, "Failed to allocate memory\n");
+		free(fits);
+		free(set);
+		return false;
+	}
+
+	rv=x11_fit_lines(xres, config, blocks, fits, set, num_lines, width, height);
+	errlog(config, LOG_INFO, "Fitted %d independent lines with %lu probes\n", num_lines, xres->stats.layout_probes-probes);
+
+	free(fits);
+	free(set);
+	return rv;
+}
+
 bool x11_align_blocks(XRESOURCES* xres, CFG* config, TEXTBLOCK** blocks, unsigned width, unsigned height){
 	//align blocks within bounding rectangle according to configured alignment
 	unsigned i, total_height=0, current_height=0;
@@ -544,9 +1261,9 @@ bool x11_align_blocks(XRESOURCES* xres, CFG* config, TEXTBLOCK** blocks, unsigne
 	return true;
 }
 
-bool x11_recalculate_blocks(CFG* config, XRESOURCES* xres, TEXTBLOCK** blocks, unsigned width, unsigned height){
+bool x11_fit_blocks(CFG* config, XRESOURCES* xres, TEXTBLOCK** blocks, unsigned width, unsigned height){
 	unsigned i, num_blocks=0;
-	unsigned layout_width=width, layout_height=height;
+	unsigned layout_width, layout_height;
 
 	//early exit.
 	if(!blocks||!blocks[0]){
@@ -572,32 +1289,24 @@ bool x11_recalculate_blocks(CFG* config, XRESOURCES* xres, TEXTBLOCK** blocks, u
 	}
 
 	//calculate layout volume
-	if(width>(2*config->padding)){
-		layout_width-=2*config->padding;
-	}
-	if(height>(2*config->padding)){
-		errlog(config, LOG_DEBUG, "Subtracting %d pixels for height padding\n", config->padding);
-		layout_height-=2*config->padding;
-	}
-	if(num_blocks>1&&(((num_blocks-1)*(config->line_spacing)<layout_height))){
-		errlog(config, LOG_DEBUG, "Subtracting %d pixels for linespacing\n", (num_blocks-1)*config->line_spacing);
-		layout_height-=(num_blocks-1)*config->line_spacing;
-	}
+	x11_layout_volume(config, num_blocks, width, height, &layout_width, &layout_height);
 
 	errlog(config, LOG_INFO, "Window volume %dx%d, layout volume %dx%d\n", width, height, layout_width, layout_height);
 
 	if(config->force_size==0){
-		//do binary search for match size
-		i=0;
-		do{
-			errlog(config, LOG_DEBUG, "Running maximizer for pass %d (%d blocks)\n", i, num_blocks);
+		if(config->independent_resize){
+			//fit every line by itself
+			if(!x11_maximize_independent(xres, config, blocks, layout_width, layout_height)){
+				return false;
+			}
+		}
+		else{
+			//search one size for all blocks
+			errlog(config, LOG_DEBUG, "Running maximizer for %d blocks\n", num_blocks);
 			if(!x11_maximize_blocks(xres, config, blocks, layout_width, layout_height)){
 				return false;
 			}
-			i++;
 		}
-		//do multiple passes if flag is set
-		while(config->independent_resize&&i<num_blocks);
 	}
 	else{
 		//render with forced size
@@ -606,7 +1315,21 @@ bool x11_recalculate_blocks(CFG* config, XRESOURCES* xres, TEXTBLOCK** blocks, u
 			return false;
 		}
 	}
-	
+
+	return true;
+}
+
+bool x11_place_blocks(CFG* config, XRESOURCES* xres, TEXTBLOCK** blocks, unsigned width, unsigned height, METRICS_BACKEND measured){
+	//early exit.
+	if(!blocks||!blocks[0]){
+		return true;
+	}
+
+	//measure the final sizes
+	if(!x11_blocks_finalize(xres, config, blocks, width, height, measured)){
+		return false;
+	}
+
 	//do alignment pass
 	if(!x11_align_blocks(xres, config, blocks, width, height)){
 		return false;
@@ -614,3 +1337,8 @@ bool x11_recalculate_blocks(CFG* config, XRESOURCES* xres, TEXTBLOCK** blocks, u
 
 	return true;
 }
+
+bool x11_recalculate_blocks(CFG* config, XRESOURCES* xres, TEXTBLOCK** blocks, unsigned width, unsigned height){
+	return x11_fit_blocks(config, xres, blocks, width, height)
+		&& x11_place_blocks(config, xres, blocks, width, height, config->metrics);
+}
@@ -10,15 +10,26 @@ int usage(char* fn){
 	printf("\t-bc <colorspec>\t\t\tSet background color by name or code\n\n");
 	printf("\t-size <n>\t\t\tRender at font size n\n\n");
 	printf("\t-maxsize <n>\t\t\tLimit font size to n at max\n\n");
+	printf("\t-hysteresis <n>\t\t\tKeep the current size while the text\n\t\t\t\t\tfits and could grow by n pixels at most\n\n");
 	printf("\t-align [n|ne|e|se|s|sw|w|nw]\tAlign text\n\n");
 	printf("\t-padding <n>\t\t\tPad text by n pixels\n\n");
 	printf("\t-linespacing <n>\t\tPad lines by n pixels\n\n");
+	printf("\t-history-lines <n>\t\tWith -stdin, keep only the last n lines\n\n");
+	printf("\t-history-bytes <n>\t\tWith -stdin, keep at most n bytes of text\n\n");
+	printf("\t-frame-delimiter <c>\t\tWith -stdin, only display input up to\n\t\t\t\t\tthe last c (nul, etb or a byte value)\n\n");
+	printf("\t-maxfps <n>\t\t\tWith -stdin, update at most n times\n\t\t\t\t\tper second\n\n");
+	printf("\t-line-cache <KiB>\t\tKeep rendered lines in pixmaps of up\n\t\t\t\t\tto KiB kilobytes in total\n\n");
+	printf("\t-measure-threads <n>\t\tMeasure lines on n threads\n\t\t\t\t\t(outline metrics only)\n\n");
+	printf("\t-metrics [outline|xft|compare]\tMeasure text from font outlines or\n\t\t\t\t\trasterized Xft glyphs while sizing,\n\t\t\t\t\tcompare logs both\n\n");
 	printf("Recognized flags:\n");
 	printf("\t-stdin\t\t\t\tUpdate text from stdin,\n\t\t\t\t\t\\f (Form feed) clears text,\n\t\t\t\t\t\\r (Carriage return) clears current line\n\n");
+	printf("\t-drain\t\t\t\tWith -stdin, skip frames that were\n\t\t\t\t\tsuperseded before they were shown\n\n");
 	printf("\t-independent-lines\t\tResize every line individually\n\n");
 	printf("\t-debugboxes\t\t\tDraw debug boxes\n\n");
 	printf("\t-disable-text\t\t\tDo not render text at all.\n\t\t\t\t\tMight be useful for playing tetris.\n\n");
-	printf("\t-disable-doublebuffer\t\tDo not use XDBE\n\n");
+	printf("\t-disable-doublebuffer\t\tDo not use a back buffer\n\n");
+	printf("\t-shm\t\t\t\tRasterize text in the client and\n\t\t\t\t\tpresent via MIT-SHM (local displays)\n\n");
+	printf("\t-layout-thread\t\t\tSize text in a worker thread,\n\t\t\t\t\tnewer input cancels running layouts\n\n");
 	printf("\t-v[v[v]]\t\t\tIncrease output verbosity\n\n");
 	return 1;
 }
@@ -38,12 +49,23 @@ int main(int argc, char** argv){
 		0, 		//padding
 		0,		//line spacing
 		0,		//max size
+		0,		//size hysteresis
+		1,		//measurement threads
+		0,		//history lines
+		0,		//history bytes
+		-1,		//frame delimiter
+		0,		//frame rate limit
+		0,		//line cache budget
 		ALIGN_CENTER, 	//alignment
+		METRICS_OUTLINE,	//metrics backend
 		false, 		//independent resize
 		false, 		//handle stdin
+		false,		//drain input to latest frame
 		false,		//draw debug boxes
 		false,		//disable text drawing
 		true,		//use double buffering
+		false,		//layout in worker thread
+		false,		//client side rendering
 		0, 		//forced size
 		NULL,	 	//text color
 		NULL,	 	//background color
@@ -55,11 +77,24 @@ int main(int argc, char** argv){
 		NULL,		//display
 		0,		//window
 		0,		//back buffer
+		false,		//back buffer is a pixmap
+		0,		//back pixmap width
+		0,		//back pixmap height
 		NULL,		//xft drawable
+		NULL,		//copy gc
 		{},		//text color
 		{},		//bg color
 		{},		//debug color
-		{NULL, 0}	//xfd set
+		{NULL, 0, -1},	//xfd set
+		NULL,		//resolved font pattern
+		{},		//font cache
+		{NULL, 0, 0, 0, 0},	//line cache
+		{NULL, 0, {}},	//outline metrics
+		{0, 0, 0, 0, 0, 0, {}},	//statistics
+		{0, true, NULL, 0, 0, NULL, 0, 0, NULL, 0, 0},	//frame damage
+		{NULL, {}, 0, false, {NULL, 0, {}}},	//shared image
+		NULL,		//layout cancel flag
+		NULL		//measurement pool
 	};
 	int args_end;
 	unsigned text_length, i;
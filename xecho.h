@@ -1,15 +1,31 @@
 #include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <ctype.h>
 #include <math.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 #include <X11/Xft/Xft.h>
 #include <X11/extensions/Xdbe.h>
+#include <X11/extensions/XShm.h>
+
+#define FONTCACHE_SIZE 32
+#define GLYPH_DENSE_RANGE 256
+#define GLYPH_SPARSE_INITIAL 64
 
 typedef enum /*_ALIGNMENT*/ {
 	ALIGN_CENTER,
@@ -23,17 +39,34 @@ typedef enum /*_ALIGNMENT*/ {
 	ALIGN_NORTHWEST
 } TEXT_ALIGN;
 
+typedef enum /*_METRICS_BACKEND*/ {
+	METRICS_XFT,
+	METRICS_OUTLINE,
+	METRICS_COMPARE
+} METRICS_BACKEND;
+
 typedef struct /*_CFG_ARGS*/ {
 	unsigned verbosity;
 	unsigned padding;
 	unsigned line_spacing;
 	unsigned max_size;
+	unsigned size_hysteresis;
+	unsigned measure_threads;
+	unsigned history_lines;
+	unsigned long history_bytes;
+	int frame_delimiter;
+	unsigned max_fps;
+	unsigned line_cache;
 	TEXT_ALIGN alignment;
+	METRICS_BACKEND metrics;
 	bool independent_resize;
 	bool handle_stdin;
+	bool drain_input;
 	bool debug_boxes;
 	bool disable_text;
 	bool double_buffer;
+	bool layout_thread;
+	bool shm_render;
 	double force_size;
 	char* text_color;
 	char* bg_color;
@@ -44,35 +77,255 @@ typedef struct /*_CFG_ARGS*/ {
 typedef struct /*XFD_AGGREG*/ {
 	int* fds;
 	unsigned size;
+	//event loop the fds are registered with, -1 if none
+	int epoll;
 } X_FDS;
 
+typedef struct /*_GLYPH_METRICS*/ {
+	FcChar32 codepoint;
+	bool valid;
+	FT_UInt index;
+	int advance;
+	int ink_left;
+	int ink_right;
+	int ink_top;
+	int ink_bottom;
+} GLYPH_METRICS;
+
+typedef struct /*_GLYPH_TABLE*/ {
+	//metrics source, either an outline face or an xft font
+	FT_Face face;
+	Display* display;
+	XftFont* font;
+	GLYPH_METRICS* dense;
+	GLYPH_METRICS* sparse;
+	unsigned sparse_size;
+	unsigned sparse_used;
+} GLYPH_TABLE;
+
+typedef struct /*_FONTCACHE_ENTRY*/ {
+	char* family;
+	double size;
+	XftFont* font;
+	GLYPH_TABLE glyphs;
+	unsigned long last_use;
+} FONTCACHE_ENTRY;
+
+typedef struct /*_FONTCACHE*/ {
+	FONTCACHE_ENTRY entries[FONTCACHE_SIZE];
+	unsigned long use_counter;
+	//entries used since are referenced by a pending draw, 0 pins nothing
+	unsigned long pinned_from;
+} FONTCACHE;
+
+typedef struct /*_LINECACHE_ENTRY*/ {
+	char* text;
+	unsigned hash;
+	double size;
+	Pixmap pixmap;
+	unsigned width;
+	unsigned height;
+	unsigned long bytes;
+	unsigned long last_use;
+} LINECACHE_ENTRY;
+
+typedef struct /*_LINECACHE*/ {
+	LINECACHE_ENTRY* entries;
+	unsigned num_entries;
+	unsigned entries_size;
+	unsigned long bytes;
+	unsigned long use_counter;
+} LINECACHE;
+
+typedef struct /*_METRICS*/ {
+	FT_Library library;
+	double units_per_em;
+	GLYPH_TABLE glyphs;
+} METRICS;
+
+typedef struct _MEASURE_POOL MEASURE_POOL;
+
+typedef struct /*_MEASURE_THREAD*/ {
+	pthread_t thread;
+	MEASURE_POOL* pool;
+	METRICS metrics;
+} MEASURE_THREAD;
+
+struct _MEASURE_POOL {
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t finished;
+	MEASURE_THREAD* threads;
+	unsigned num_threads;
+	bool shutdown;
+	//current batch
+	unsigned long batch;
+	unsigned pending;
+	struct _TEXT_BLOCK** blocks;
+	unsigned count;
+	double size;
+	atomic_uint next;
+	atomic_bool failed;
+};
+
+typedef struct /*_FRAME_DAMAGE*/ {
+	unsigned long frame;
+	//everything needs to be drawn, eg. after expose or resize
+	bool full;
+	//block boxes drawn in the last frame, top to bottom
+	XRectangle* boxes;
+	unsigned num_boxes;
+	unsigned boxes_size;
+	//areas to be redrawn in the current frame
+	XRectangle* rects;
+	unsigned num_rects;
+	unsigned rects_size;
+	//glyphs of the current frame, sent in one request
+	XftGlyphFontSpec* specs;
+	unsigned num_specs;
+	unsigned specs_size;
+} FRAME_DAMAGE;
+
+typedef struct /*_SHM_TARGET*/ {
+	//frame image shared with the server
+	XImage* image;
+	XShmSegmentInfo segment;
+	//ShmCompletion event type, set while the server may read the image
+	int completion;
+	bool pending;
+	//rasterizer face, sized per line
+	METRICS raster;
+} SHM_TARGET;
+
+typedef struct /*_STATS*/ {
+	unsigned long layout_passes;
+	unsigned long layout_probes;
+	unsigned long layouts_cancelled;
+	unsigned long frames_dropped;
+	//time spent in synchronous layouts
+	unsigned long layout_ns;
+	unsigned long frames_drawn;
+	//start of the first frame, rates are taken over wall time
+	struct timespec first_frame;
+} STATS;
+
 typedef struct /*_XDATA*/ {
 	int screen;
 	Display* display;
 	Window main;
 	XdbeBackBuffer back_buffer;
+	//without xdbe, the back buffer is a plain pixmap copied to the window
+	bool back_pixmap;
+	unsigned back_width;
+	unsigned back_height;
 	XftDraw* drawable;
+	GC copy_gc;
 	XftColor text_color;
 	XftColor bg_color;
 	XftColor debug_color;
 	X_FDS xfds;
+	FcPattern* font_pattern;
+	FONTCACHE fonts;
+	LINECACHE lines;
+	METRICS metrics;
+	STATS stats;
+	FRAME_DAMAGE damage;
+	//client side rendering, if enabled
+	SHM_TARGET shm;
+	//set from another thread to abort a running layout
+	atomic_bool* cancel;
+	//parallel measurement, if enabled
+	MEASURE_POOL* pool;
 } XRESOURCES;
 
-typedef struct /*_TEXT_BLOCK*/ {
+typedef struct _TEXT_BLOCK {
 	unsigned layout_x;
 	unsigned layout_y;
 	double size;
 	char* text;
+	unsigned length;
+	unsigned capacity;
 	bool active;
 	bool calculated;
+	//text changed since the extents were measured
+	bool dirty;
 	XGlyphInfo extents;
+	//where the block was last drawn, and whether that is stale
+	XRectangle drawn;
+	double drawn_size;
+	unsigned long drawn_frame;
+	bool damaged;
 } TEXTBLOCK;
 
+typedef struct /*_STRING_STREAM*/ {
+	//line records, the last one is the current line
+	TEXTBLOCK** ring;
+	unsigned ring_size;
+	unsigned first;
+	unsigned lines;
+	unsigned long bytes;
+	//history limits, 0 is unbounded
+	unsigned max_lines;
+	unsigned long max_bytes;
+	bool clear_pending;
+	//recent frame peaks, decaying by half per frame, allocations shrink below them
+	unsigned peak_lines;
+	unsigned peak_length;
+	//lines in display order, as handed to layout
+	TEXTBLOCK** view;
+	//input after the last frame commit marker, -1 commits every read
+	int delimiter;
+	char* held;
+	unsigned held_length;
+	unsigned held_capacity;
+} STRING_STREAM;
+
+typedef struct /*_LINE_FIT*/ {
+	TEXTBLOCK* block;
+	unsigned index;
+	unsigned size;
+} LINE_FIT;
+
+typedef struct /*_LAYOUT_WORKER*/ {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wakeup;
+	int notify[2];
+	bool running;
+	bool shutdown;
+	//private configuration and font resources
+	CFG config;
+	XRESOURCES res;
+	atomic_bool cancel;
+	//latest submitted job
+	unsigned long generation;
+	bool job_ready;
+	unsigned job_width;
+	unsigned job_height;
+	TEXTBLOCK** job;
+	TEXTBLOCK** work;
+	//last published layout
+	bool result_ready;
+	bool failed;
+	unsigned long result_generation;
+	TEXTBLOCK** result;
+} LAYOUT_WORKER;
+
 #define DEFAULT_FONT "verdana"
 #define DEFAULT_TEXTCOLOR "black"
 #define DEFAULT_WINCOLOR "white"
 #define DEFAULT_DEBUGCOLOR "red"
 #define STDIN_DATA_CHUNK 512
+#define STDIN_DRAIN_CHUNK 32768
+#define STDIN_DRAIN_READS 4
+#define EVENT_BATCH 16
+#define CONFIGURE_SETTLE_MS 50
+#define DAMAGE_MARGIN 1
+#define TEXTBLOCK_INITIAL 32
+#define STREAM_RING_INITIAL 16
+#define PREDICTOR_REFERENCE_SIZE 64
+#define PREDICTOR_ROUNDS 2
+#define MEASURE_PARALLEL_MIN 16
 
 #define LOG_DEBUG 3
 #define LOG_INFO 2
@@ -81,5 +334,11 @@ void errlog(CFG* config, unsigned level, char* fmt, ...);
 #include "colorspec.c"
 #include "arguments.c"
 #include "strings.c"
+#include "metrics.c"
+#include "fontcache.c"
+#include "linecache.c"
+#include "shm.c"
+#include "pool.c"
 #include "x11.c"
+#include "worker.c"
 #include "logic.c"